@@ -1,531 +1,5258 @@
 #include <GL/glut.h>
+#include <GL/freeglut_ext.h> // glutGetProcAddress for loading buffer object entry points
+#include <GL/glext.h>
+#if defined(__linux__) && !defined(NO_HEADLESS)
+#define HEADLESS_SUPPORTED 1 // Offscreen rendering through EGL (Mesa surfaceless platform)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#define SCENE_MMAP 1 // --scene files are memory-mapped; elsewhere they are read into memory
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
 
-// Boat state
-float boatX = -1.2f;
-float boatY = 0.1f; // Y-position of the boat's base, aligned with water top
-bool boatVisible = true;
-float boatMovementSpeed = 0.01f; // Speed for boat animation towards target (for mouse click)
-float keyboardBoatSpeed = 0.02f; // Speed for boat movement via keyboard
-float targetBoatX = boatX;       // Target X position for boat movement (for mouse click)
-bool isBoatMoving = false;       // Flag to indicate if boat is currently animating (for mouse click)
+// Boat tuning (speeds are per second of simulated time, so they don't depend on the frame rate)
+float boatMovementSpeed = 0.6f; // Speed for boat animation towards target (for mouse click)
+float keyboardBoatSpeed = 0.02f; // Distance the boat moves per key press
+float sinkSpeed = 0.3f; // Speed at which the boat sinks
 
-// Sinking animation state
-bool isSinking = false;
-float sinkSpeed = 0.005f; // Speed at which the boat sinks
-bool completelyGone = false; // Flag to indicate if boat has sunk completely
+// Fixed-timestep simulation: the world advances in ticks of 1/simulationRate seconds, and
+// rendering interpolates between the last two ticks
+int simulationRate = 60;           // Ticks per second, --sim-hz
+int frameIntervalMs = 16;          // Redisplay period, --fps
+const double maxFrameDelta = 0.25; // Longest real time caught up in one frame (after a stall or a breakpoint)
+double simulationAccumulator = 0.0; // Real time not yet consumed by ticks
+float renderAlpha = 1.0f;           // Blend factor between the previous and current tick
+std::uint32_t simulationTick = 0;   // Ticks run so far
+
+// Story boat start position (a --scene file may move it)
+float boatStartX = -1.2f;
+float boatStartY = 0.1f; // Y-position of the boat's base, aligned with water top
+
+// Boat state flags, packed into one byte per boat
+enum BoatFlags : unsigned char {
+    BOAT_VISIBLE = 1 << 0, // Afloat: can move and collide
+    BOAT_MOVING = 1 << 1,  // Animating towards targetX (mouse click, or fleet patrol leg)
+    BOAT_SINKING = 1 << 2, // Hit an iceberg and is going down
+    BOAT_GONE = 1 << 3,    // Sunk completely below the screen
+    BOAT_PATROL = 1 << 4   // Fleet boat: on arrival, turn around and head for patrolX
+};
+
+// All boat state as structure-of-arrays, so per-tick updates stream through contiguous memory.
+// Boat 0 is the story boat driven by the keyboard and mouse; fleet boats follow it.
+struct BoatStore {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> prevX;   // Position at the previous tick, for render interpolation
+    std::vector<float> prevY;
+    std::vector<float> baseY;   // Height the boat floats at; y drops below it while sinking
+    std::vector<float> targetX; // Where a moving boat is heading
+    std::vector<float> patrolX; // Other end of a patrol leg
+    std::vector<float> speed;   // Movement per second towards targetX
+    std::vector<float> scale;
+    std::vector<float> tint;    // RGB per boat, multiplied with the mesh colors
+    std::vector<unsigned char> flags;
+
+    int size() const { return (int)x.size(); }
+
+    int add(float startX, float startY, float moveSpeed, float boatScale, unsigned char initialFlags) {
+        x.push_back(startX);
+        y.push_back(startY);
+        prevX.push_back(startX);
+        prevY.push_back(startY);
+        baseY.push_back(startY);
+        targetX.push_back(startX);
+        patrolX.push_back(startX);
+        speed.push_back(moveSpeed);
+        scale.push_back(boatScale);
+        tint.insert(tint.end(), { 1.0f, 1.0f, 1.0f });
+        flags.push_back(initialFlags);
+        return size() - 1;
+    }
+
+    // Remember the current positions before a tick moves them
+    void savePrevious() {
+        std::copy(x.begin(), x.end(), prevX.begin());
+        std::copy(y.begin(), y.end(), prevY.begin());
+    }
+
+    // Jump without interpolating from the old position (resets, teleports)
+    void snap(int boat) {
+        prevX[boat] = x[boat];
+        prevY[boat] = y[boat];
+    }
+
+    // Position to draw at, between the previous and the current tick
+    float renderX(int boat) const { return prevX[boat] + (x[boat] - prevX[boat]) * renderAlpha; }
+    float renderY(int boat) const { return prevY[boat] + (y[boat] - prevY[boat]) * renderAlpha; }
+
+    bool has(int boat, unsigned char flag) const { return (flags[boat] & flag) != 0; }
+    void set(int boat, unsigned char flag) { flags[boat] |= flag; }
+    void clear(int boat, unsigned char flag) { flags[boat] &= (unsigned char)~flag; }
+};
+
+BoatStore boats;
+const int storyBoat = 0;
+
+// Small persistent thread pool; parallelFor() splits an index range into chunks that the
+// workers and the calling thread pull from an atomic counter
+struct WorkerPool {
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::mutex callerMutex; // One parallelFor() at a time; only the thread running the simulation uses the pool
+    std::function<void(int, int)> job;
+    std::atomic<int> nextChunk{ 0 };
+    int count = 0;
+    int chunkSize = 0;
+    int busyWorkers = 0;
+    unsigned generation = 0;
+    bool stopping = false;
+
+    void start(int workerCount) {
+        for (int i = 0; i < workerCount; i++) threads.emplace_back([this] { workerLoop(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    void runChunks() {
+        for (;;) {
+            int begin = nextChunk.fetch_add(1) * chunkSize;
+            if (begin >= count) return;
+            job(begin, std::min(begin + chunkSize, count));
+        }
+    }
+
+    void workerLoop() {
+        unsigned seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            runChunks();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busyWorkers == 0) finished.notify_one();
+        }
+    }
+
+    // Run job(begin, end) over [0, total); small ranges run inline on the calling thread
+    void parallelFor(int total, int minChunk, const std::function<void(int, int)>& work) {
+        if (threads.empty() || total < 2 * minChunk) {
+            if (total > 0) work(0, total);
+            return;
+        }
+        std::lock_guard<std::mutex> caller(callerMutex);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = work;
+            count = total;
+            int chunks = (int)threads.size() * 4 + 4; // A few chunks per thread to even out the load
+            chunkSize = std::max(minChunk, (total + chunks - 1) / chunks);
+            nextChunk = 0;
+            busyWorkers = (int)threads.size();
+            generation++;
+        }
+        wake.notify_all();
+        runChunks();
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [&] { return busyWorkers == 0; });
+    }
+};
+
+WorkerPool workers;
+int workerThreadCount = -1;           // --threads; -1 uses every hardware thread
+const int boatUpdateChunk = 4096;     // Boats per parallel chunk; smaller fleets update inline
+
+// Branch-free float select: bitwise blend, so no floating-point work has to be made conditional
+inline float selectFloat(unsigned condition, float a, float b) {
+    std::uint32_t bitsA, bitsB;
+    std::memcpy(&bitsA, &a, sizeof(float));
+    std::memcpy(&bitsB, &b, sizeof(float));
+    std::uint32_t mask = 0u - (condition & 1u);
+    std::uint32_t bits = (bitsA & mask) | (bitsB & ~mask);
+    float result;
+    std::memcpy(&result, &bits, sizeof(float));
+    return result;
+}
+
+// Advance boats [begin, end) by one tick: mouse/patrol movement towards targetX for boats
+// that are afloat, and sinking for boats that hit an iceberg. Every value is computed
+// unconditionally and picked with selectFloat()/flag masks, so the loop has no branches and
+// GCC/Clang vectorize it at -O3. The decisions are the same as the original per-boat
+// timer() logic, with speeds scaled by the tick length dt.
+void updateBoatKernel(float* __restrict x, float* __restrict y, float* __restrict targetX, float* __restrict patrolX,
+    const float* __restrict speed, unsigned char* __restrict flags, int begin, int end, float dt, float sink) {
+    float sinkStep = sink * dt;
+    for (int i = begin; i < end; i++) {
+        unsigned f = flags[i];
+        unsigned visible = f & BOAT_VISIBLE;
+        unsigned moving = (f >> 1) & visible;              // BOAT_MOVING while afloat
+        unsigned sinking = (f >> 2) & (visible ^ 1u) & 1u; // BOAT_SINKING once no longer afloat
+        unsigned patrol = (f >> 4) & 1u;                   // BOAT_PATROL
+
+        // Move towards the target, or snap onto it when within one step
+        float step = speed[i] * dt;
+        float distance = targetX[i] - x[i];
+        unsigned far = std::fabs(distance) > step;
+        float stepped = x[i] + selectFloat(distance > 0, step, -step);
+        x[i] = selectFloat(moving, selectFloat(far, stepped, targetX[i]), x[i]);
+        unsigned arrived = moving & (far ^ 1u);
+
+        // Patrolling boats turn around on arrival instead of stopping
+        unsigned turn = arrived & patrol;
+        float target = targetX[i];
+        targetX[i] = selectFloat(turn, patrolX[i], target);
+        patrolX[i] = selectFloat(turn, target, patrolX[i]);
+
+        // Sink, and mark the boat gone once it is below the screen
+        float sunkY = y[i] - sinkStep;
+        y[i] = selectFloat(sinking, sunkY, y[i]);
+        unsigned gone = sinking & (unsigned)(sunkY < -1.0f);
+
+        f &= ~((arrived & (patrol ^ 1u)) * BOAT_MOVING | gone * BOAT_SINKING);
+        f |= gone * BOAT_GONE;
+        flags[i] = (unsigned char)f;
+    }
+}
+
+void updateBoatRange(BoatStore& store, int begin, int end, float dt, float sink) {
+    updateBoatKernel(store.x.data(), store.y.data(), store.targetX.data(), store.patrolX.data(),
+        store.speed.data(), store.flags.data(), begin, end, dt, sink);
+}
+
+// Advance every boat by one tick of dt seconds, split across the worker pool for large fleets
+void updateBoats(float dt) {
+    bool storyWasSinking = boats.has(storyBoat, BOAT_SINKING);
+    workers.parallelFor(boats.size(), boatUpdateChunk, [dt](int begin, int end) {
+        updateBoatRange(boats, begin, end, dt, sinkSpeed);
+    });
+    if (storyWasSinking && boats.has(storyBoat, BOAT_GONE)) {
+        std::cout << "Boat has completely sunk." << std::endl;
+    }
+}
+
+// Put a boat at (x, y), afloat and idle
+void resetBoat(BoatStore& store, int boat, float x, float y) {
+    store.x[boat] = x;
+    store.y[boat] = y;
+    store.targetX[boat] = x;
+    store.flags[boat] = BOAT_VISIBLE;
+    store.snap(boat);
+}
+
+// Put the story boat back at its start position, afloat and idle
+void resetStoryBoat() {
+    resetBoat(boats, storyBoat, boatStartX, boatStartY);
+}
+
+// Send a boat towards targetX at the given speed (a mouse click); only while it is afloat
+void sendBoat(BoatStore& store, int boat, float targetX, float speed) {
+    if (!store.has(boat, BOAT_VISIBLE)) return;
+    store.targetX[boat] = targetX;
+    store.speed[boat] = speed;
+    store.set(boat, BOAT_MOVING); // Start boat animation
+}
+
+// Move a boat sideways by dx at once (the A/D keys); only while it is afloat
+void nudgeBoat(BoatStore& store, int boat, float dx) {
+    if (!store.has(boat, BOAT_VISIBLE)) return;
+    store.x[boat] += dx;
+    store.clear(boat, BOAT_MOVING); // Stop any mouse-based target movement
+}
 
 // Zoom state for iceberg
 float icebergZoomFactor = 2.0f; // Initial larger zoom for iceberg
+bool oceanEnabled = false;      // --ocean / 'O'; the flat water is drawn when off
+
+// Iceberg position (top-right corner, now on the water; a --scene file may move it)
+float icebergX = 1.2f; // X-coordinate for the center of the iceberg
+float icebergY = 0.1f; // Y-coordinate for the base of the iceberg, aligned with water
+
+// Rectangle in world coordinates
+struct ViewRect {
+    float left, right, bottom, top;
+};
+
+// Objects binned by a reference point into square cells. The cells are loose: an object may
+// stick out of its cell by up to margin, so a query grows its rectangle by margin instead of
+// each object being inserted into every cell it touches. Moving an object re-bins it only when
+// its reference point crosses into another cell.
+struct LooseGrid {
+    float minX = 0.0f, minY = 0.0f;
+    float cellSize = 0.5f;
+    int columns = 1, rows = 1;
+    float margin = 0.0f;                   // Largest extent of an object beyond its reference point
+    std::vector<std::vector<int>> cells;
+    std::vector<int> cellOf;               // Per object: its cell
+    std::vector<int> slotOf;               // Per object: its index in that cell's list
+    std::uint64_t version = 0;             // Bumped whenever an object changes cell
+    long long moves = 0;                   // Objects re-binned into another cell, for statistics
+
+    void reset(float left, float bottom, float right, float top, float size) {
+        minX = left;
+        minY = bottom;
+        cellSize = size;
+        columns = std::max(1, (int)std::ceil((right - left) / size));
+        rows = std::max(1, (int)std::ceil((top - bottom) / size));
+        margin = 0.0f;
+        cells.assign((size_t)columns * rows, std::vector<int>());
+        cellOf.clear();
+        slotOf.clear();
+        version++;
+    }
+    int column(float x) const { return std::min(columns - 1, std::max(0, (int)std::floor((x - minX) / cellSize))); }
+    int row(float y) const { return std::min(rows - 1, std::max(0, (int)std::floor((y - minY) / cellSize))); }
+    int cellAt(float x, float y) const { return row(y) * columns + column(x); }
+
+    void add(int id, int cell) {
+        cellOf[id] = cell;
+        slotOf[id] = (int)cells[cell].size();
+        cells[cell].push_back(id);
+    }
+    void insert(int id, float x, float y, float extent) {
+        if (id >= (int)cellOf.size()) {
+            cellOf.resize(id + 1, -1);
+            slotOf.resize(id + 1, -1);
+        }
+        margin = std::max(margin, extent);
+        add(id, cellAt(x, y));
+        version++;
+    }
+    void move(int id, float x, float y) {
+        int cell = cellAt(x, y);
+        if (cell == cellOf[id]) return;
+        version++;
+        moves++;
+        std::vector<int>& old = cells[cellOf[id]];
+        int last = old.back(); // Swap-remove, fixing the moved object's slot
+        old[slotOf[id]] = last;
+        slotOf[last] = slotOf[id];
+        old.pop_back();
+        add(id, cell);
+    }
+    // Call visit(id) for every object in the cells the rectangle (grown by margin) overlaps.
+    // Objects outside the grid were clamped into its edge cells, so those are visited too.
+    template <typename Visit>
+    int query(const ViewRect& rect, Visit&& visit) const {
+        int visited = 0;
+        int c0 = column(rect.left - margin), c1 = column(rect.right + margin);
+        int r0 = row(rect.bottom - margin), r1 = row(rect.top + margin);
+        for (int r = r0; r <= r1; r++) {
+            for (int c = c0; c <= c1; c++) {
+                for (int id : cells[(size_t)r * columns + c]) visit(id);
+                visited += (int)cells[(size_t)r * columns + c].size();
+            }
+        }
+        return visited;
+    }
+};
+
+// Fleet boat i (boat 1 + i in the boat store) at (x, baseY); re-binned by the simulation as the
+// boats move and published with the snapshots, so drawing only queries it
+LooseGrid fleetBoatGrid;
+
+// --- Simulation snapshots ---
+// With the simulation thread (see simulationThreadLoop()) the boats, the iceberg zoom, the ocean
+// toggle and the tick belong to that thread. After every tick it publishes an immutable copy of
+// what rendering reads (the boats and their fleet grid among it) through a lock-free triple buffer, and the GL thread draws the newest
+// copy. Rendering reads simulation state only through drawnBoats(), drawnIcebergZoom(),
+// drawnOceanEnabled(), drawnFleetBoatGrid() and drawnTick(); without the thread those return the live state.
+
+std::uint64_t inputsApplied = 0;                         // Live input events applied by the simulation so far
+std::chrono::steady_clock::time_point newestInputQueued; // When the newest applied event was queued
+
+struct SimSnapshot {
+    BoatStore boats;       // Only the fields rendering reads are filled in
+    float icebergZoom = 2.0f;
+    bool oceanEnabled = false;
+    LooseGrid fleetBoatGrid; // Copied only when its version changed since this slot was last filled
+    std::uint32_t tick = 0;
+    std::uint64_t inputsApplied = 0;
+    std::chrono::steady_clock::time_point newestInputQueued;
+    std::chrono::steady_clock::time_point published; // Real time of the tick, for interpolation
+};
+
+// One writer, one reader, no locks: the writer fills its back slot and swaps it with the middle
+// one; the reader swaps its front slot with the middle one only if that holds something newer.
+// Neither side ever waits for the other.
+struct SnapshotTripleBuffer {
+    static const int freshBit = 4;
+    SimSnapshot slots[3];
+    std::atomic<int> middle{ 1 };
+    int back = 0;  // Writer only
+    int front = 2; // Reader only
+
+    SimSnapshot& writeSlot() { return slots[back]; }
+    void publish() { back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & 3; }
+    const SimSnapshot& latest() {
+        if (middle.load(std::memory_order_acquire) & freshBit) front = middle.exchange(front, std::memory_order_acq_rel) & 3;
+        return slots[front];
+    }
+};
+
+SnapshotTripleBuffer snapshots;
+const SimSnapshot* shownSnapshot = nullptr; // The snapshot this frame draws; nullptr without the simulation thread
+
+// Copy what rendering reads into a snapshot slot (the vectors keep their capacity, so this
+// allocates nothing once the slots have been filled)
+void captureSnapshot(SimSnapshot& snapshot) {
+    BoatStore& to = snapshot.boats;
+    to.x = boats.x;
+    to.y = boats.y;
+    to.prevX = boats.prevX;
+    to.prevY = boats.prevY;
+    to.baseY = boats.baseY;
+    to.scale = boats.scale;
+    to.tint = boats.tint;
+    to.flags = boats.flags;
+    snapshot.icebergZoom = icebergZoomFactor;
+    snapshot.oceanEnabled = oceanEnabled;
+    if (snapshot.fleetBoatGrid.version != fleetBoatGrid.version) snapshot.fleetBoatGrid = fleetBoatGrid;
+    snapshot.tick = simulationTick;
+    snapshot.inputsApplied = inputsApplied;
+    snapshot.newestInputQueued = newestInputQueued;
+    snapshot.published = std::chrono::steady_clock::now();
+}
 
-// Iceberg position (top-right corner, now on the water)
-const float icebergX = 1.2f; // X-coordinate for the center of the iceberg
-const float icebergY = 0.1f; // Y-coordinate for the base of the iceberg, aligned with water
+const BoatStore& drawnBoats() { return shownSnapshot ? shownSnapshot->boats : boats; }
+float drawnIcebergZoom() { return shownSnapshot ? shownSnapshot->icebergZoom : icebergZoomFactor; }
+bool drawnOceanEnabled() { return shownSnapshot ? shownSnapshot->oceanEnabled : oceanEnabled; }
+const LooseGrid& drawnFleetBoatGrid() { return shownSnapshot ? shownSnapshot->fleetBoatGrid : fleetBoatGrid; }
+std::uint32_t drawnTick() { return shownSnapshot ? shownSnapshot->tick : simulationTick; }
 
 // Sun's position (also the light source position)
 const float sunLightX = -1.0f;
 const float sunLightY = 0.8f;
 const float sunLightZ = 0.5f; // Z-coordinate to give it some depth/direction
 
-// Function to draw a circle/filled polygon (for sun - no longer used for clouds)
-void drawCircle(float cx, float cy, float r, int num_segments) {
-    glBegin(GL_TRIANGLE_FAN);
-    glVertex3f(cx, cy, 0.0f); // Center of circle, now with Z=0
-    for (int i = 0; i <= num_segments; i++) {
-        float theta = 2.0f * 3.1415926f * float(i) / float(num_segments); // Get the current angle
-        float x = r * cosf(theta); // Calculate the x component
-        float y = r * sinf(theta); // Calculate the y component
-        glVertex3f(cx + x, cy + y, 0.0f); // Output vertex, now with Z=0
+// Light and material properties, shared by the fixed-function setup in init() and the shader renderer
+const GLfloat lightAmbient[] = { 0.2f, 0.2f, 0.2f, 1.0f };  // Dim ambient light
+const GLfloat lightDiffuse[] = { 1.0f, 1.0f, 0.8f, 1.0f };  // Bright yellowish-white diffuse light (sun-like)
+const GLfloat lightSpecular[] = { 1.0f, 1.0f, 1.0f, 1.0f }; // White specular highlight
+const GLfloat sceneAmbient[] = { 0.2f, 0.2f, 0.2f, 1.0f };  // OpenGL's default GL_LIGHT_MODEL_AMBIENT
+const GLfloat materialSpecular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+const GLfloat materialShininess = 50.0f; // A moderate shininess
+
+// Render path switch: retained-mode meshes (VBO/VAO) or the original glBegin/glEnd code
+bool useRetainedMeshes = true; // Toggled with 'M', or started off with --immediate
+
+// OpenGL 1.5+ entry points that are not exported by every platform's GL headers,
+// loaded at runtime in loadGLFunctions()
+#define GL_EXTENSION_FUNCTIONS(X) \
+    X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+    X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
+    X(PFNGLBINDBUFFERPROC, glBindBuffer) \
+    X(PFNGLBUFFERDATAPROC, glBufferData) \
+    X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays) \
+    X(PFNGLDELETEVERTEXARRAYSPROC, glDeleteVertexArrays) \
+    X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray) \
+    X(PFNGLBUFFERSUBDATAPROC, glBufferSubData) \
+    X(PFNGLMAPBUFFERPROC, glMapBuffer) \
+    X(PFNGLUNMAPBUFFERPROC, glUnmapBuffer) \
+    X(PFNGLCREATESHADERPROC, glCreateShader) \
+    X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+    X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+    X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
+    X(PFNGLDELETESHADERPROC, glDeleteShader) \
+    X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+    X(PFNGLATTACHSHADERPROC, glAttachShader) \
+    X(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation) \
+    X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+    X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
+    X(PFNGLUSEPROGRAMPROC, glUseProgram) \
+    X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer) \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
+    X(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor) \
+    X(PFNGLDRAWELEMENTSINSTANCEDPROC, glDrawElementsInstanced) \
+    X(PFNGLGENFRAMEBUFFERSPROC, glGenFramebuffers) \
+    X(PFNGLDELETEFRAMEBUFFERSPROC, glDeleteFramebuffers) \
+    X(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer) \
+    X(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus) \
+    X(PFNGLGENRENDERBUFFERSPROC, glGenRenderbuffers) \
+    X(PFNGLDELETERENDERBUFFERSPROC, glDeleteRenderbuffers) \
+    X(PFNGLBINDRENDERBUFFERPROC, glBindRenderbuffer) \
+    X(PFNGLRENDERBUFFERSTORAGEPROC, glRenderbufferStorage) \
+    X(PFNGLFRAMEBUFFERRENDERBUFFERPROC, glFramebufferRenderbuffer) \
+    X(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D) \
+    X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
+    X(PFNGLUNIFORM1IPROC, glUniform1i) \
+    X(PFNGLGENQUERIESPROC, glGenQueries) \
+    X(PFNGLBEGINQUERYPROC, glBeginQuery) \
+    X(PFNGLENDQUERYPROC, glEndQuery) \
+    X(PFNGLGETQUERYOBJECTIVPROC, glGetQueryObjectiv) \
+    X(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v) \
+    X(PFNGLQUERYCOUNTERPROC, glQueryCounter) \
+    X(PFNGLGETUNIFORMBLOCKINDEXPROC, glGetUniformBlockIndex) \
+    X(PFNGLUNIFORMBLOCKBINDINGPROC, glUniformBlockBinding) \
+    X(PFNGLBINDBUFFERBASEPROC, glBindBufferBase) \
+    X(PFNGLUNIFORM1FPROC, glUniform1f) \
+    X(PFNGLUNIFORM4FPROC, glUniform4f)
+
+#define DECLARE_GL_FUNCTION(type, name) static type name = nullptr;
+GL_EXTENSION_FUNCTIONS(DECLARE_GL_FUNCTION)
+#undef DECLARE_GL_FUNCTION
+static PFNGLACTIVETEXTUREPROC selectTextureUnit = nullptr; // glActiveTexture; some gl.h already declare that name
+
+bool headlessMode = false; // --headless: no window or GLUT, rendering goes to an offscreen framebuffer
+
+// Look up a GL entry point through whichever API created the context
+void (*getGLProcAddress(const char* name))() {
+#ifdef HEADLESS_SUPPORTED
+    if (headlessMode) return (void (*)())eglGetProcAddress(name);
+#endif
+    return (void (*)())glutGetProcAddress(name);
+}
+
+// Load the entry points above; returns false if buffer objects are unsupported
+bool loadGLFunctions() {
+#define LOAD_GL_FUNCTION(type, name) name = (type)getGLProcAddress(#name);
+    GL_EXTENSION_FUNCTIONS(LOAD_GL_FUNCTION)
+#undef LOAD_GL_FUNCTION
+    selectTextureUnit = (PFNGLACTIVETEXTUREPROC)getGLProcAddress("glActiveTexture");
+    // Vertex array objects are optional: without them the client state is set up on every draw
+    return glGenBuffers && glDeleteBuffers && glBindBuffer && glBufferData;
+}
+
+// Window (or offscreen surface) size, kept up to date by reshape()
+int windowWidth = 800;
+int windowHeight = 600;
+
+// Dynamic resolution (--frame-budget): the scene is drawn into an offscreen target a fraction
+// of the window's size, picked from measured frame times, and upscaled to the window
+struct DynamicResolution {
+    double budgetMs = 0.0;   // 0 = off: the scene is drawn straight into the window
+    float scale = 1.0f;      // Target width and height as a fraction of the window's
+    const float minScale = 0.4f;
+    const float step = 0.05f;        // Scales are multiples of this, so small jitter can't resize the target
+    const int sampleFrames = 20;     // Frames averaged before each decision
+    const double raiseBelow = 0.75;  // Scale back up only once the average is this far under the budget
+    double sampleSumMs = 0.0;
+    int samples = 0;
+    double lastAverageMs = 0.0;      // Average of the last full sample window
+    double nativeAverageMs = 0.0;    // Last average at full scale, drawn straight into the window
+    const int holdWindows = 15;      // Sample windows to stay at full scale after scaling didn't pay
+    int hold = 0;
+    int width = 0, height = 0;       // Size of the target
+    GLuint framebuffer = 0, colorTexture = 0, depthBuffer = 0;
+    int changes = 0;
+    double scaleSum = 0.0;           // For the mean scale over the run
+    long long frames = 0;
+    // Windowed runs: GL_TIMESTAMP pairs around each frame's rendering, read back once available
+    static const int timerSlots = 4;
+    GLuint timestamps[timerSlots][2] = {};
+    double submitMs[timerSlots] = {}; // CPU time of the same frame
+    bool timerPending[timerSlots] = {};
+    int nextTimer = 0;
+    long long untimedFrames = 0;     // Every slot was still waiting for the GPU
+};
+DynamicResolution dynamicResolution;
+
+// Size the scene is rendered at: the window's, or the dynamic resolution target's
+int sceneWidth = 800;
+int sceneHeight = 600;
+
+// Work submitted to GL in the current frame, reported by the headless benchmark
+struct RenderCounters {
+    long long drawCalls = 0;
+    long long vertices = 0;
+    long long stateChangesSubmitted = 0; // Render queue: state changes in submission order, drawn object by object
+    long long stateChangesExecuted = 0;  // Render queue: state changes actually issued
+    long long objectsVisited = 0;        // Fleet objects in the grid cells the camera overlaps
+};
+RenderCounters frameCounters;
+
+// Record draw calls and the vertices they submitted
+void countDraw(long long drawCalls, long long vertices) {
+    frameCounters.drawCalls += drawCalls;
+    frameCounters.vertices += vertices;
+}
+
+void countDraw(long long vertices) {
+    countDraw(1, vertices);
+}
+
+// --- Frame profiler ---
+// PROFILE_SCOPE times a block on the CPU; PROFILE_GPU_SCOPE also wraps it in a GL_TIME_ELAPSED
+// query. Queries are polled on later frames and only read once their result is available, so
+// the profiler never waits for the GPU. With the profiler off a scope is one branch on a bool;
+// building with -DNO_PROFILER removes the scopes entirely.
+
+struct ProfileEvent {
+    const char* name;
+    long long startNs;    // Since the profiler started
+    long long durationNs;
+    int thread;           // Small per-thread number; gpuTraceThread for GPU times
+};
+
+// Per-scope totals for the overlay
+struct ProfileStat {
+    const char* name;
+    double cpuMs = 0.0, gpuMs = 0.0;
+    int cpuCount = 0, gpuCount = 0;
+};
+
+// A query in flight
+struct GpuTiming {
+    const char* name;
+    long long cpuStartNs; // Where the GPU time is placed in the trace
+    GLuint query;
+};
+
+struct Profiler {
+    std::atomic<bool> enabled{ false }; // --profile, --trace or 'P'; read by every thread
+    bool overlay = false;          // 'P'
+    bool gpuTimers = false;        // GL_TIME_ELAPSED queries are supported
+    bool gpuQueryActive = false;   // Time-elapsed queries cannot nest: inner GPU scopes are CPU-only
+    std::string tracePath;         // --trace <file>
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    std::mutex mutex;              // Scopes may close on worker or simulation threads
+    std::vector<ProfileEvent> trace;
+    std::vector<ProfileStat> stats;      // Accumulating since the overlay last refreshed
+    std::vector<ProfileStat> shownStats; // Per-frame averages shown by the overlay
+    std::vector<ProfileStat> totals;     // Whole run, for the headless summary
+    int statFrames = 0, shownFrames = 0, totalFrames = 0;
+    long long lastRefreshNs = 0;
+    std::vector<GpuTiming> pendingQueries;
+    std::vector<GLuint> freeQueries;
+    long long gpuScopesSkipped = 0; // Too many queries still in flight
+};
+Profiler profiler;
+bool profilerRequested = false; // --profile / --trace: enabled once the GL context exists
+
+const int gpuTraceThread = 1000;
+const size_t maxTraceEvents = 4000000; // Bounds the trace's memory on long sessions
+const size_t maxPendingQueries = 512;
+
+long long profilerNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler.origin).count();
+}
+
+// Small stable thread numbers for the trace (main thread first)
+int profilerThreadNumber() {
+    static std::atomic<int> nextThread(1);
+    thread_local int thread = nextThread++;
+    return thread;
+}
+
+ProfileStat& profileStat(std::vector<ProfileStat>& stats, const char* name) {
+    for (ProfileStat& stat : stats) {
+        if (stat.name == name) return stat; // Names are string literals
+    }
+    stats.push_back(ProfileStat());
+    stats.back().name = name;
+    return stats.back();
+}
+
+void recordProfileEvent(const char* name, long long startNs, long long durationNs, int thread, bool gpu) {
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    for (std::vector<ProfileStat>* stats : { &profiler.stats, &profiler.totals }) {
+        ProfileStat& stat = profileStat(*stats, name);
+        if (gpu) {
+            stat.gpuMs += durationNs * 1e-6;
+            stat.gpuCount++;
+        }
+        else {
+            stat.cpuMs += durationNs * 1e-6;
+            stat.cpuCount++;
+        }
+    }
+    if (!profiler.tracePath.empty() && profiler.trace.size() < maxTraceEvents) {
+        profiler.trace.push_back({ name, startNs, durationNs, thread });
+    }
+}
+
+// Start a time-elapsed query for a GPU scope; false if it has to stay CPU-only
+bool beginGpuTiming(const char* name, long long cpuStartNs) {
+    if (!profiler.gpuTimers || profiler.gpuQueryActive) return false;
+    if (profiler.pendingQueries.size() >= maxPendingQueries) {
+        profiler.gpuScopesSkipped++;
+        return false;
+    }
+    GLuint query;
+    if (profiler.freeQueries.empty()) glGenQueries(1, &query);
+    else {
+        query = profiler.freeQueries.back();
+        profiler.freeQueries.pop_back();
+    }
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    profiler.gpuQueryActive = true;
+    profiler.pendingQueries.push_back({ name, cpuStartNs, query });
+    return true;
+}
+
+void endGpuTiming() {
+    glEndQuery(GL_TIME_ELAPSED);
+    profiler.gpuQueryActive = false;
+}
+
+// Collect the GPU times that have become available, without waiting for the others
+void pollGpuTimings() {
+    size_t kept = 0;
+    for (size_t i = 0; i < profiler.pendingQueries.size(); i++) {
+        GpuTiming timing = profiler.pendingQueries[i];
+        GLint available = 0;
+        glGetQueryObjectiv(timing.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            profiler.pendingQueries[kept++] = timing;
+            continue;
+        }
+        GLuint64 elapsedNs = 0;
+        glGetQueryObjectui64v(timing.query, GL_QUERY_RESULT, &elapsedNs);
+        recordProfileEvent(timing.name, timing.cpuStartNs, (long long)elapsedNs, gpuTraceThread, true);
+        profiler.freeQueries.push_back(timing.query);
+    }
+    profiler.pendingQueries.resize(kept);
+}
+
+// Called once per rendered frame: poll the GPU and refresh the overlay's averages twice a second
+void profilerFrame() {
+    if (!profiler.enabled) return;
+    if (profiler.gpuTimers) pollGpuTimings();
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    profiler.statFrames++;
+    profiler.totalFrames++;
+    long long now = profilerNowNs();
+    if (now - profiler.lastRefreshNs >= 500000000LL) {
+        profiler.shownStats = profiler.stats;
+        profiler.shownFrames = profiler.statFrames;
+        profiler.stats.clear();
+        profiler.statFrames = 0;
+        profiler.lastRefreshNs = now;
+    }
+}
+
+// Timing scope, closed at the end of the enclosing block
+struct ProfileScope {
+    const char* name;
+    long long startNs = -1;
+    bool gpu = false;
+
+    ProfileScope(const char* name, bool gpu) : name(name) {
+        if (!profiler.enabled) return;
+        startNs = profilerNowNs();
+        this->gpu = gpu && beginGpuTiming(name, startNs);
+    }
+    ~ProfileScope() {
+        if (startNs < 0) return;
+        if (gpu) endGpuTiming();
+        recordProfileEvent(name, startNs, profilerNowNs() - startNs, profilerThreadNumber(), false);
+    }
+};
+
+#ifdef NO_PROFILER
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#else
+#define PROFILE_SCOPE(name) ProfileScope profileScope(name, false)
+#define PROFILE_GPU_SCOPE(name) ProfileScope profileScope(name, true)
+#endif
+
+// Turn profiling on; GPU timers need GL_TIME_ELAPSED queries (OpenGL 3.3 or ARB_timer_query)
+void enableProfiler() {
+    profilerThreadNumber(); // The main thread is thread 1 in the trace
+    profiler.enabled = true;
+    profiler.gpuTimers = glGenQueries && glBeginQuery && glEndQuery && glGetQueryObjectiv && glGetQueryObjectui64v;
+}
+
+// Per-frame CPU/GPU milliseconds per scope: the overlay's last half second, or the whole run
+std::vector<std::string> profilerReport(bool wholeRun) {
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    std::vector<std::string> lines;
+    const std::vector<ProfileStat>& stats = wholeRun ? profiler.totals : profiler.shownStats;
+    int frames = std::max(1, wholeRun ? profiler.totalFrames : profiler.shownFrames);
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-22s %8s %8s", "scope (ms/frame)", "CPU", "GPU");
+    lines.push_back(line);
+    for (const ProfileStat& stat : stats) {
+        if (stat.gpuCount) std::snprintf(line, sizeof(line), "%-22s %8.3f %8.3f", stat.name, stat.cpuMs / frames, stat.gpuMs / frames);
+        else std::snprintf(line, sizeof(line), "%-22s %8.3f %8s", stat.name, stat.cpuMs / frames, "-");
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// Overlay in the top-left corner of the window (needs GLUT's bitmap fonts, so windowed only)
+void drawProfilerOverlay() {
+    if (!profiler.overlay || headlessMode) return;
+    std::vector<std::string> lines = profilerReport(false);
+    char line[128];
+    std::snprintf(line, sizeof(line), "%lld draw calls, %lld state changes (%lld unsorted)", frameCounters.drawCalls,
+        frameCounters.stateChangesExecuted, frameCounters.stateChangesSubmitted);
+    lines.push_back(line);
+    if (dynamicResolution.budgetMs > 0.0) {
+        std::snprintf(line, sizeof(line), "resolution %.0f%% (%dx%d), %.2f ms average for a %.1f ms budget", dynamicResolution.scale * 100.0f,
+            sceneWidth, sceneHeight, dynamicResolution.lastAverageMs, dynamicResolution.budgetMs);
+        lines.push_back(line);
+    }
+    glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0.0, windowWidth, windowHeight, 0.0, -1.0, 1.0); // Pixel coordinates, y down
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+    glColor3f(0.0f, 0.0f, 0.0f);
+    for (size_t i = 0; i < lines.size(); i++) {
+        glRasterPos2i(8, 18 + (int)i * 15);
+        glutBitmapString(GLUT_BITMAP_9_BY_15, (const unsigned char*)lines[i].c_str());
+    }
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+}
+
+// Write the recorded scopes as Chrome trace-event JSON (chrome://tracing, Perfetto)
+void saveProfilerTrace() {
+    if (profiler.tracePath.empty()) return;
+    std::lock_guard<std::mutex> lock(profiler.mutex);
+    std::ofstream file(profiler.tracePath);
+    file << "{\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"main\"}},\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << gpuTraceThread << ",\"args\":{\"name\":\"GPU (time elapsed, at submission)\"}}";
+    char event[256];
+    for (const ProfileEvent& e : profiler.trace) {
+        std::snprintf(event, sizeof(event), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            e.name, e.thread == gpuTraceThread ? "gpu" : "cpu", e.thread, e.startNs * 1e-3, e.durationNs * 1e-3);
+        file << event;
+    }
+    file << "\n]}\n";
+    if (!file) std::cout << "Could not write " << profiler.tracePath << std::endl;
+    else std::cout << "Wrote " << profiler.trace.size() << " trace events to " << profiler.tracePath << std::endl;
+    profiler.tracePath.clear(); // Only once
+}
+
+// Interleaved vertex layout shared by all retained-mode meshes
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+    float color[3];
+};
+
+// Geometry that lives in GPU buffers and is drawn with a single indexed draw call
+struct Mesh {
+    GLuint vertexBuffer = 0;
+    GLuint indexBuffer = 0;
+    GLuint vertexArray = 0;  // 0 when vertex array objects are unavailable
+    GLuint attributeArray = 0; // Generic vertex attributes for the shader renderer, 0 when it is off
+    GLenum primitive = GL_TRIANGLES;
+    GLsizei indexCount = 0;
+};
+
+// Collects geometry on the CPU with an immediate-mode style interface.
+// Quads are split into two triangles so a whole object can be drawn with GL_TRIANGLES.
+struct MeshBuilder {
+    std::vector<MeshVertex> vertices;
+    std::vector<GLushort> indices;
+    float currentNormal[3] = { 0.0f, 0.0f, 1.0f };
+    float currentColor[3] = { 1.0f, 1.0f, 1.0f };
+    GLenum currentMode = GL_TRIANGLES;
+    size_t primitiveStart = 0; // First vertex of the current glBegin-style block
+
+    void color(float r, float g, float b) {
+        currentColor[0] = r; currentColor[1] = g; currentColor[2] = b;
+    }
+    void normal(float x, float y, float z) {
+        currentNormal[0] = x; currentNormal[1] = y; currentNormal[2] = z;
+    }
+    void begin(GLenum mode) {
+        currentMode = mode;
+        primitiveStart = vertices.size();
+    }
+    void vertex(float x, float y, float z) {
+        MeshVertex v;
+        v.position[0] = x; v.position[1] = y; v.position[2] = z;
+        std::memcpy(v.normal, currentNormal, sizeof(v.normal));
+        std::memcpy(v.color, currentColor, sizeof(v.color));
+        vertices.push_back(v);
+    }
+    void end() {
+        GLushort first = (GLushort)primitiveStart;
+        GLushort count = (GLushort)(vertices.size() - primitiveStart);
+        if (currentMode == GL_QUADS) {
+            for (GLushort q = 0; q + 3 < count; q += 4) { // Each quad becomes two triangles
+                GLushort a = first + q;
+                GLushort quad[6] = { a, (GLushort)(a + 1), (GLushort)(a + 2), a, (GLushort)(a + 2), (GLushort)(a + 3) };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        else if (currentMode == GL_TRIANGLE_FAN) { // Fan around the first vertex
+            for (GLushort i = 1; i + 1 < count; i++) {
+                GLushort triangle[3] = { first, (GLushort)(first + i), (GLushort)(first + i + 1) };
+                indices.insert(indices.end(), triangle, triangle + 3);
+            }
+        }
+        else if (currentMode == GL_QUAD_STRIP) { // Each pair of vertices closes a quad with the previous pair
+            for (GLushort i = 0; i + 3 < count; i += 2) {
+                GLushort a = first + i;
+                GLushort quad[6] = { a, (GLushort)(a + 1), (GLushort)(a + 3), a, (GLushort)(a + 3), (GLushort)(a + 2) };
+                indices.insert(indices.end(), quad, quad + 6);
+            }
+        }
+        else { // GL_TRIANGLES and GL_LINES are indexed as-is
+            for (GLushort i = 0; i < count; i++) indices.push_back(first + i);
+        }
+    }
+};
+
+// Upload vertices and indices into GPU buffers
+Mesh createMesh(const MeshVertex* vertices, size_t vertexCount, const GLushort* indices, size_t indexCount, GLenum primitive) {
+    Mesh mesh;
+    mesh.primitive = primitive;
+    mesh.indexCount = (GLsizei)indexCount;
+
+    if (glGenVertexArrays && glBindVertexArray) {
+        glGenVertexArrays(1, &mesh.vertexArray);
+        glBindVertexArray(mesh.vertexArray);
+    }
+
+    glGenBuffers(1, &mesh.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(MeshVertex), vertices, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &mesh.indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLushort), indices, GL_STATIC_DRAW);
+
+    if (mesh.vertexArray) {
+        // The vertex array object records the pointers and the index buffer binding once
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, position));
+        glNormalPointer(GL_FLOAT, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, normal));
+        glColorPointer(3, GL_FLOAT, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, color));
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return mesh;
+}
+
+Mesh createMesh(const MeshBuilder& builder, GLenum primitive) {
+    return createMesh(builder.vertices.data(), builder.vertices.size(), builder.indices.data(), builder.indices.size(), primitive);
+}
+
+// Draw a retained-mode mesh with one indexed draw call
+void drawMesh(const Mesh& mesh) {
+    if (mesh.vertexArray) {
+        glBindVertexArray(mesh.vertexArray);
+        glDrawElements(mesh.primitive, mesh.indexCount, GL_UNSIGNED_SHORT, nullptr);
+        glBindVertexArray(0);
+        countDraw(mesh.indexCount);
+        return;
+    }
+
+    // No vertex array objects: set up the client state by hand
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, position));
+    glNormalPointer(GL_FLOAT, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, normal));
+    glColorPointer(3, GL_FLOAT, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, color));
+    glDrawElements(mesh.primitive, mesh.indexCount, GL_UNSIGNED_SHORT, nullptr);
+    countDraw(mesh.indexCount);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Meshes built once in buildSceneMeshes()
+Mesh boatMesh;         // Hull, rudder and sail
+Mesh icebergMesh;      // Triangular prism
+Mesh icebergCrackMesh; // Unlit crack lines on the iceberg's front face
+Mesh skyMesh;          // Gradient quad, unlit
+Mesh sunMesh;          // Glow and core discs, unlit
+Mesh waterMesh;        // Water surface, lit
+Mesh waveMesh;         // Unlit wave lines
+
+// --- Clouds ---
+// A cloud is one of a few hand-made shapes (a cluster of sphere puffs), placed and scaled.
+// The three original clouds are the shapes at their own positions; --clouds adds more.
+// A --scene file may replace both the shapes and the clouds.
+
+struct CloudPuff {
+    float x, y, z; // Offset from the cloud's position
+    float radius;
+};
+
+struct CloudShape {
+    float x, y, z; // Where the hand-placed cloud sits; its impostor is baked (and lit) there
+    std::vector<CloudPuff> puffs;
+};
+
+std::vector<CloudShape> cloudShapes = {
+    { 0.5f, 0.7f, -0.5f, { { 0.0f, 0.0f, 0.0f, 0.12f }, { 0.08f, 0.05f, 0.03f, 0.1f }, { -0.07f, 0.03f, -0.02f, 0.09f }, { 0.02f, -0.05f, 0.05f, 0.1f } } },
+    { -0.3f, 0.85f, -0.6f, { { 0.0f, 0.0f, 0.0f, 0.1f }, { -0.06f, -0.02f, 0.01f, 0.08f }, { 0.05f, 0.03f, -0.03f, 0.09f } } },
+    { 0.0f, 0.5f, -0.4f, { { 0.0f, 0.0f, 0.0f, 0.07f }, { 0.04f, 0.03f, 0.02f, 0.06f }, { -0.03f, -0.01f, -0.01f, 0.05f } } },
+};
+
+struct Cloud {
+    int shape;
+    float x, y, z;
+    float scale;
+};
+
+// Level of detail: shared unit spheres, from the original 20x20 down
+const int cloudLodCount = 3;
+const int cloudLodSlices[cloudLodCount] = { 20, 12, 8 };
+const int cloudLodStacks[cloudLodCount] = { 20, 10, 6 };
+const float cloudLodPixels[cloudLodCount - 1] = { 24.0f, 10.0f }; // Smallest on-screen puff radius for LOD 0 and 1
+const float cloudImpostorPixels = 20.0f; // Clouds with a smaller on-screen radius are drawn as impostors
+const int cloudImpostorTile = 64;        // Atlas tile size per shape, in texels
+
+// A sphere of a 3D cloud, in world space, with the LOD picked for it
+struct CloudSphereDraw {
+    float x, y, z, radius;
+    int lod;
+};
+
+struct ImpostorVertex {
+    float position[3];
+    float texCoord[2];
+};
+
+struct CloudLayer {
+    std::vector<Cloud> clouds;
+    int extraClouds = 0;        // --clouds <n>
+    bool useLod = true;         // --no-cloud-lod: every cloud as full-detail spheres, for comparison
+    Mesh spheres[cloudLodCount];
+    GLuint impostorAtlas = 0;   // One baked tile per shape; 0 without framebuffer objects
+    GLuint impostorBuffer = 0;  // Camera-facing quads of the clouds currently drawn as impostors
+    GLsizei impostorVertices = 0;
+    std::vector<CloudSphereDraw> sphereDraws; // Spheres of the clouds currently drawn in 3D
+    float classifiedPixelsPerUnit = 0.0f;      // Scale the two lists were built for
+    int impostorClouds = 0;
+};
+CloudLayer cloudLayer;
+
+// Shader renderer (--shaders): one uber-shader compiled into a program per permutation,
+// set up in initShaderRenderer(); without --shaders, fleet mode builds the two it draws with
+enum ShaderPermutation { SHADER_LIT = 1, SHADER_INSTANCED = 2, SHADER_PERMUTATIONS = 4 };
+bool useShaderRenderer = false;                 // Active; fixed-function GL_LIGHT0 otherwise
+GLuint uberPrograms[SHADER_PERMUTATIONS] = {};
+GLint uberModelOffset[SHADER_PERMUTATIONS] = {}; // Per-draw transform uniforms (non-instanced permutations)
+GLint uberModelScale[SHADER_PERMUTATIONS] = {};
+GLint uberModelTint[SHADER_PERMUTATIONS] = {};   // White except while drawInstancesOneByOne() draws the fleet
+
+// Baked static lighting (updateBakedLighting()): unlit copies of the lit static meshes with the
+// light evaluated into their vertex colors
+struct BakedLighting {
+    bool enabled = true;             // --live-lighting / 'L': light every mesh every frame instead
+    float lightPosition[4] = {};     // Backdrop light the water and clouds were baked with
+    float icebergLight[4] = {};      // World light the iceberg was baked with; it follows the camera
+    float icebergZoom = 0.0f;        // Zoom baked into the iceberg
+    float cloudPixelsPerUnit = 0.0f; // Cloud LOD choice baked into the cloud meshes
+    bool sceneryValid = false;       // Water and clouds
+    bool icebergValid = false;
+    Mesh water;
+    Mesh iceberg;                    // In world space, at the baked zoom
+    std::vector<Mesh> clouds;        // All 3D clouds in world space, split to fit 16-bit indices
+    int bakes = 0;
+};
+BakedLighting bakedLighting;
+
+// Fixed-function retained path only: the shader renderer lights per pixel, and immediate mode
+// stays the untouched reference
+bool bakedLightingActive() {
+    return bakedLighting.enabled && useRetainedMeshes && !useShaderRenderer && boatMesh.vertexBuffer != 0;
+}
+
+// --- Render queue ---
+// On the retained path the draw functions don't draw: they submit commands (mesh, transform,
+// lighting) with a sort key, and executeRenderQueue() sorts them so lighting toggles, vertex
+// array binds and transforms change once per group instead of once per object. Commands come
+// from a per-frame arena, so a steady-state frame does no heap allocation.
+
+// Bump allocator rewound after every queue execution. Its blocks are kept, so it only reaches
+// the heap while the scene is still growing.
+struct FrameArena {
+    struct Block {
+        std::unique_ptr<unsigned char[]> memory;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t currentBlock = 0;
+    size_t offset = 0;
+    long long heapAllocations = 0;
+
+    void reset() {
+        currentBlock = 0;
+        offset = 0;
+    }
+    void* allocate(size_t bytes) {
+        bytes = (bytes + 15) & ~(size_t)15;
+        for (; currentBlock < blocks.size(); currentBlock++, offset = 0) {
+            if (offset + bytes <= blocks[currentBlock].size) {
+                void* memory = blocks[currentBlock].memory.get() + offset;
+                offset += bytes;
+                return memory;
+            }
+        }
+        size_t size = std::max(bytes, blocks.empty() ? (size_t)64 * 1024 : blocks.back().size * 2);
+        blocks.push_back({ std::unique_ptr<unsigned char[]>(new unsigned char[size]), size });
+        heapAllocations++;
+        currentBlock = blocks.size() - 1;
+        offset = bytes;
+        return blocks.back().memory.get();
+    }
+    template <typename T> T* create(const T& value) {
+        return new (allocate(sizeof(T))) T(value);
+    }
+};
+
+// Passes run in order; the background is also drawn on its own into the background cache
+enum RenderPass { PASS_BACKGROUND = 0, PASS_WORLD = 1 };
+
+struct RenderCommand {
+    const Mesh* mesh;
+    float translate[3];
+    float scale[3]; // Z is only scaled for the cloud spheres
+    bool lit;
+};
+
+struct RenderQueue {
+    struct Item {
+        std::uint64_t key;
+        RenderCommand* command;
+    };
+    std::vector<Item> items; // Cleared after each execution, capacity kept
+    FrameArena arena;
+    bool sorted = true;      // 'Q' / --unsorted-queue: draw in submission order, object by object
+};
+RenderQueue renderQueue;
+
+// Sort key, most significant first: pass (4 bits), lighting (lit first), primitive (triangles
+// before lines), mesh (16 bits), depth (18 bits, front to back) and submission order (24 bits),
+// which keeps std::sort stable for the 16M draws a frame can queue before it wraps
+std::uint64_t renderSortKey(RenderPass pass, const Mesh& mesh, bool lit, float depth, size_t sequence) {
+    float front = std::min(1.0f, std::max(0.0f, (1.0f - depth) * 0.5f)); // glOrtho: larger Z is closer
+    std::uint64_t key = (std::uint64_t)pass << 60;
+    key |= (std::uint64_t)(lit ? 0 : 1) << 59;
+    key |= (std::uint64_t)(mesh.primitive == GL_LINES ? 1 : 0) << 58;
+    key |= (std::uint64_t)(mesh.vertexBuffer & 0xFFFF) << 42;
+    key |= (std::uint64_t)(front * 0x3FFFF) << 24;
+    key |= sequence & 0xFFFFFF;
+    return key;
+}
+
+// Queue a mesh at (x, y, z) and scale; depth orders it among draws of the same mesh
+void submitMesh(RenderPass pass, const Mesh& mesh, bool lit, float depth, float x = 0.0f, float y = 0.0f, float z = 0.0f, float scaleX = 1.0f, float scaleY = 1.0f, float scaleZ = 1.0f) {
+    RenderCommand* command = renderQueue.arena.create(RenderCommand{ &mesh, { x, y, z }, { scaleX, scaleY, scaleZ }, lit });
+    renderQueue.items.push_back({ renderSortKey(pass, mesh, lit, depth, renderQueue.items.size()), command });
+}
+
+bool sameTransform(const RenderCommand& a, const RenderCommand& b) {
+    return std::memcmp(a.translate, b.translate, sizeof(a.translate)) == 0 && std::memcmp(a.scale, b.scale, sizeof(a.scale)) == 0;
+}
+
+// Lighting and transform as the executor tracks them, on either renderer. The fixed-function
+// path switches GL_LIGHTING and the modelview matrix; the shader path switches between the lit
+// and unlit programs and sets the transform uniforms.
+struct RenderState {
+    bool lit = true;
+    bool transformSet = false;
+    GLuint program = 0;
+
+    void setLighting(bool on) {
+        lit = on;
+        if (useShaderRenderer) {
+            program = uberPrograms[on ? SHADER_LIT : 0];
+            glUseProgram(program);
+            transformSet = false; // Uniforms belong to the program
+        }
+        else if (on) glEnable(GL_LIGHTING);
+        else glDisable(GL_LIGHTING);
+    }
+    void setTransform(const RenderCommand& command) {
+        transformSet = true;
+        if (useShaderRenderer) {
+            int permutation = lit ? SHADER_LIT : 0;
+            glUniform4f(uberModelOffset[permutation], command.translate[0], command.translate[1], command.translate[2], 0.0f);
+            glUniform4f(uberModelScale[permutation], command.scale[0], command.scale[1], command.scale[2], 0.0f);
+            return;
+        }
+        glPopMatrix();
+        glPushMatrix();
+        glTranslatef(command.translate[0], command.translate[1], command.translate[2]);
+        glScalef(command.scale[0], command.scale[1], command.scale[2]);
+    }
+};
+
+// Draw a mesh with whatever vertex array the active renderer reads
+void drawQueuedMesh(const Mesh& mesh, GLuint& boundArray, long long& stateChanges) {
+    GLuint vertexArray = useShaderRenderer ? mesh.attributeArray : mesh.vertexArray;
+    if (!vertexArray) { // No vertex array objects: drawMesh() sets the arrays up itself
+        drawMesh(mesh);
+        stateChanges++;
+        return;
+    }
+    if (vertexArray != boundArray) {
+        glBindVertexArray(vertexArray);
+        boundArray = vertexArray;
+        stateChanges++;
+    }
+    glDrawElements(mesh.primitive, mesh.indexCount, GL_UNSIGNED_SHORT, nullptr);
+    countDraw(mesh.indexCount);
+}
+
+// Draw everything queued since the last call. Lighting is on before and after.
+void executeRenderQueue() {
+    if (renderQueue.items.empty()) return;
+    PROFILE_GPU_SCOPE("executeRenderQueue");
+    std::vector<RenderQueue::Item>& items = renderQueue.items;
+    // What the per-object draw functions changed: every object sets its transform and binds its
+    // mesh, and unlit ones switch lighting off and back on
+    long long submitted = 0;
+    for (const RenderQueue::Item& item : items) submitted += item.command->lit ? 2 : 4;
+    frameCounters.stateChangesSubmitted += submitted;
+    if (renderQueue.sorted) {
+        std::sort(items.begin(), items.end(), [](const RenderQueue::Item& a, const RenderQueue::Item& b) { return a.key < b.key; });
+    }
+
+    long long executed = 0;
+    RenderState state;
+    if (useShaderRenderer) state.setLighting(true); // The fixed-function path starts with lighting on already
+    GLuint boundArray = 0;
+    const RenderCommand* previous = nullptr;
+    glPushMatrix();
+    for (const RenderQueue::Item& item : items) {
+        const RenderCommand& command = *item.command;
+        if (!renderQueue.sorted) { // Object by object, the way the draw functions used to do it
+            if (!command.lit) state.setLighting(false);
+            state.setTransform(command);
+            boundArray = 0;
+            drawQueuedMesh(*command.mesh, boundArray, executed);
+            if (!command.lit) state.setLighting(true);
+            continue;
+        }
+        if (command.lit != state.lit) {
+            state.setLighting(command.lit);
+            executed++;
+        }
+        if (!state.transformSet || !previous || !sameTransform(command, *previous)) {
+            state.setTransform(command);
+            executed++;
+        }
+        previous = &command;
+        drawQueuedMesh(*command.mesh, boundArray, executed);
+    }
+    glPopMatrix();
+    if (boundArray) glBindVertexArray(0);
+    if (!state.lit && !useShaderRenderer) glEnable(GL_LIGHTING);
+    if (useShaderRenderer) glUseProgram(0);
+    frameCounters.stateChangesExecuted += renderQueue.sorted ? executed : submitted;
+    items.clear();
+    renderQueue.arena.reset();
+}
+
+// --- Camera and world grid ---
+// The world is a strip of ocean along X (--world <width>). The camera scrolls along it and zooms
+// about the horizon line, so the backdrop (sky, sun, clouds, flat water) stays fixed on screen
+// and only world objects move. The camera lives in the projection: world objects are drawn with
+// glOrtho over the visible rectangle and an identity modelview, so eye space is world space.
+// Fleet boats and icebergs are kept in loose grids, and a frame only visits the cells the view
+// rectangle overlaps, however long the world is.
+
+const float horizonY = 0.1f; // Y of the horizon, in world and backdrop units; zooming keeps it in place
+float worldWidth = 3.0f;      // --world <width>: span of the fleet along X, centered on 0
+
+struct Camera {
+    float x = 0.0f;    // World X at the center of the screen
+    float zoom = 1.0f; // Screen size of a world unit; 1 is the original view
+};
+Camera camera;
+
+// World rectangle on screen; at x 0 and zoom 1 it is the original glOrtho box
+ViewRect cameraView() {
+    return { camera.x - 1.5f / camera.zoom, camera.x + 1.5f / camera.zoom,
+        horizonY - (horizonY + 1.0f) / camera.zoom, horizonY + (1.0f - horizonY) / camera.zoom };
+}
+
+// The original fixed view, used for the backdrop
+void applyBackdropProjection() {
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(-1.5f, 1.5f, -1.0f, 1.0f, -1.0f, 1.0f); // x, y, near Z, far Z
+    glMatrixMode(GL_MODELVIEW);
+}
+
+void applyCameraProjection() {
+    ViewRect view = cameraView();
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(view.left, view.right, view.bottom, view.top, -1.0f, 1.0f);
+    glMatrixMode(GL_MODELVIEW);
+}
+
+// A point of the backdrop (say, the sun) at the world position that appears in the same place
+void backdropToWorld(const float backdrop[4], float world[4]) {
+    world[0] = camera.x + backdrop[0] / camera.zoom;
+    world[1] = horizonY + (backdrop[1] - horizonY) / camera.zoom;
+    world[2] = backdrop[2];
+    world[3] = backdrop[3];
+}
+
+// Mouse picking: window pixel column to world X, and back
+float cameraWorldX(int pixelX) {
+    ViewRect view = cameraView();
+    return view.left + (view.right - view.left) * pixelX / windowWidth;
+}
+
+int cameraPixelX(float worldX) {
+    ViewRect view = cameraView();
+    return (int)((worldX - view.left) / (view.right - view.left) * windowWidth);
+}
+
+bool cameraSees(float left, float bottom, float right, float top) {
+    ViewRect view = cameraView();
+    return right >= view.left && left <= view.right && top >= view.bottom && bottom <= view.top;
+}
+
+// Keep the view on the world: zoom out at most until the whole strip fits, in at most 8x
+void clampCamera() {
+    camera.zoom = std::min(8.0f, std::max(std::min(1.0f, 3.0f / worldWidth), camera.zoom));
+    float halfWidth = worldWidth * 0.5f;
+    camera.x = std::min(halfWidth, std::max(-halfWidth, camera.x));
+}
+
+// --- Scene files (--scene <file>, written by --write-scene <file>) ---
+// A scene file holds the retained meshes, the cloud shapes and every placed object, so content
+// can change without recompiling. It is a header and a section table followed by flat arrays of
+// fixed-size records, each 16-byte aligned, in native byte order. Loading maps the file and
+// points into it: nothing is parsed or copied before the vertex and index arrays go straight
+// to glBufferData(). Only the objects the simulation moves are copied into the boat store.
+
+enum SceneSectionType : std::uint32_t {
+    SCENE_MESHES = 1,         // SceneMeshRecord per mesh
+    SCENE_VERTICES = 2,       // MeshVertex, all meshes back to back
+    SCENE_INDICES = 3,        // GLushort, relative to each mesh's first vertex
+    SCENE_CLOUD_SHAPES = 4,   // SceneCloudShape per shape
+    SCENE_CLOUD_PUFFS = 5,    // CloudPuff, all shapes back to back
+    SCENE_STORY = 6,          // SceneObject: the story boat, then the story iceberg (scale = zoom)
+    SCENE_CLOUDS = 7,         // SceneObject per cloud (shape, position, scale)
+    SCENE_FLEET_BOATS = 8,    // SceneObject per fleet boat (position, scale, tint, speed, patrol target)
+    SCENE_FLEET_ICEBERGS = 9, // SceneObject per fleet iceberg (position, scale, tint)
+};
+
+struct SceneFileHeader {
+    char magic[4];              // "BSCN"
+    std::uint32_t version;      // 1
+    std::uint32_t sectionCount; // SceneSection records right after the header
+    float worldWidth;           // Span of the fleet along X
+};
+
+struct SceneSection {
+    std::uint32_t type;  // SceneSectionType
+    std::uint32_t count; // Records in the section
+    std::uint64_t offset; // From the start of the file
+    std::uint64_t bytes;
+};
+
+struct SceneMeshRecord {
+    char name[24];       // Zero-padded, e.g. "boat" or "cloud_sphere1"
+    std::uint32_t primitive;
+    std::uint32_t firstVertex, vertexCount;
+    std::uint32_t firstIndex, indexCount;
+    std::uint32_t reserved;
+};
+
+struct SceneCloudShape {
+    float x, y, z;       // Where the shape's impostor is baked
+    std::uint32_t firstPuff, puffCount;
+};
+
+struct SceneObject {
+    float x, y, z;
+    float scale;
+    float color[3];
+    float speed;
+    float targetX;
+    std::uint32_t shape;
+};
+
+struct SceneFile {
+    std::string path;          // --scene <file>; empty when the built-in scene is used
+    const unsigned char* data = nullptr;
+    std::size_t size = 0;
+    std::vector<unsigned char> storage; // The file's bytes where it cannot be mapped
+    const SceneSection* sections[SCENE_FLEET_ICEBERGS + 1] = {}; // By type, nullptr when absent
+    double loadMs = 0.0;       // Mapping, validating and applying the objects
+    double uploadMs = 0.0;     // Mesh uploads in buildSceneMeshes()
+
+    bool loaded() const { return data != nullptr; }
+    bool hasFleet() const { return count(SCENE_FLEET_BOATS) + count(SCENE_FLEET_ICEBERGS) > 0; }
+    std::uint32_t count(SceneSectionType type) const { return sections[type] ? sections[type]->count : 0; }
+    template <typename T>
+    const T* records(SceneSectionType type) const { return sections[type] ? (const T*)(data + sections[type]->offset) : nullptr; }
+};
+SceneFile scene;
+
+// Map the whole file read-only (or read it, without mmap)
+bool mapSceneFile(SceneFile& file) {
+#ifdef SCENE_MMAP
+    int descriptor = open(file.path.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+    struct stat info;
+    void* mapping = MAP_FAILED;
+    if (fstat(descriptor, &info) == 0 && info.st_size > 0) mapping = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor); // The mapping stays valid
+    if (mapping == MAP_FAILED) return false;
+    file.data = (const unsigned char*)mapping;
+    file.size = (size_t)info.st_size;
+#else
+    std::ifstream stream(file.path, std::ios::binary | std::ios::ate);
+    if (!stream) return false;
+    file.storage.resize((size_t)stream.tellg());
+    stream.seekg(0);
+    if (!stream.read((char*)file.storage.data(), file.storage.size())) return false;
+    file.data = file.storage.data();
+    file.size = file.storage.size();
+#endif
+    return true;
+}
+
+// Every section inside the file and large enough for its records, every mesh inside the arrays
+bool validateScene(const SceneFile& file) {
+    const SceneFileHeader* header = (const SceneFileHeader*)file.data;
+    if (file.size < sizeof(SceneFileHeader) || std::memcmp(header->magic, "BSCN", 4) != 0 || header->version != 1) return false;
+    if (header->sectionCount > (file.size - sizeof(SceneFileHeader)) / sizeof(SceneSection)) return false;
+    const std::size_t recordSize[SCENE_FLEET_ICEBERGS + 1] = { 0, sizeof(SceneMeshRecord), sizeof(MeshVertex), sizeof(GLushort),
+        sizeof(SceneCloudShape), sizeof(CloudPuff), sizeof(SceneObject), sizeof(SceneObject), sizeof(SceneObject), sizeof(SceneObject) };
+    const SceneSection* sections = (const SceneSection*)(file.data + sizeof(SceneFileHeader));
+    for (std::uint32_t i = 0; i < header->sectionCount; i++) {
+        const SceneSection& section = sections[i];
+        if (section.type == 0 || section.type > SCENE_FLEET_ICEBERGS) continue; // From a newer writer
+        if (section.offset % 16 != 0 || section.offset > file.size || section.bytes > file.size - section.offset) return false;
+        if ((std::uint64_t)section.count * recordSize[section.type] > section.bytes) return false;
+    }
+    return true;
+}
+
+// Map a scene file and apply its small tables. Must run before init(): the meshes are uploaded
+// by buildSceneMeshes(), the clouds and the fleet created from the file by createClouds() and initFleet().
+// NaN or infinity from a damaged file would reach the transforms and the broadphase bounds
+bool sceneObjectFinite(const SceneObject& object) {
+    return std::isfinite(object.x) && std::isfinite(object.y) && std::isfinite(object.scale) && std::isfinite(object.speed) && std::isfinite(object.targetX);
+}
+
+bool openScene(const std::string& path) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    scene.path = path;
+    if (!mapSceneFile(scene)) {
+        std::cout << "Could not open scene " << path << std::endl;
+        return false;
+    }
+    if (!validateScene(scene)) {
+        std::cout << "Not a valid scene file: " << path << std::endl;
+        return false;
+    }
+    const SceneFileHeader* header = (const SceneFileHeader*)scene.data;
+    const SceneSection* sections = (const SceneSection*)(scene.data + sizeof(SceneFileHeader));
+    for (std::uint32_t i = 0; i < header->sectionCount; i++) {
+        if (sections[i].type > 0 && sections[i].type <= SCENE_FLEET_ICEBERGS) scene.sections[sections[i].type] = &sections[i];
+    }
+
+    // The vertex data is uploaded as it is; only the ranges, the primitive and the indices are
+    // checked, so a damaged file can't make the GPU fetch past a mesh's vertices
+    const SceneMeshRecord* meshes = scene.records<SceneMeshRecord>(SCENE_MESHES);
+    const GLushort* indices = scene.records<GLushort>(SCENE_INDICES);
+    for (std::uint32_t i = 0; i < scene.count(SCENE_MESHES); i++) {
+        const SceneMeshRecord& mesh = meshes[i];
+        if ((std::uint64_t)mesh.firstVertex + mesh.vertexCount > scene.count(SCENE_VERTICES)
+            || (std::uint64_t)mesh.firstIndex + mesh.indexCount > scene.count(SCENE_INDICES) || mesh.name[23] != '\0') {
+            std::cout << "Scene mesh " << i << " is out of range in " << path << std::endl;
+            return false;
+        }
+        // The primitives writeScene() emits, with whole primitives only
+        bool triangles = mesh.primitive == GL_TRIANGLES && mesh.indexCount % 3 == 0;
+        bool lines = mesh.primitive == GL_LINES && mesh.indexCount % 2 == 0;
+        if (!triangles && !lines) {
+            std::cout << "Scene mesh " << i << " has an unsupported primitive " << mesh.primitive << " in " << path << std::endl;
+            return false;
+        }
+        for (std::uint32_t k = 0; k < mesh.indexCount; k++) {
+            if (indices[mesh.firstIndex + k] >= mesh.vertexCount) {
+                std::cout << "Scene mesh " << i << " indexes past its " << mesh.vertexCount << " vertices in " << path << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // The fleet is read where it is created, so it is checked here; a scale of zero or less
+    // would flip its grid bounds
+    for (SceneSectionType type : { SCENE_FLEET_BOATS, SCENE_FLEET_ICEBERGS }) {
+        const SceneObject* objects = scene.records<SceneObject>(type);
+        for (std::uint32_t i = 0; i < scene.count(type); i++) {
+            if (!sceneObjectFinite(objects[i]) || objects[i].scale <= 0.0f) {
+                std::cout << "Scene fleet " << (type == SCENE_FLEET_BOATS ? "boat " : "iceberg ") << i << " has a bad position or scale in " << path << std::endl;
+                return false;
+            }
+        }
+    }
+
+    // Small tables are applied now; the clouds and the fleet are read where they are created
+    const SceneObject* story = scene.records<SceneObject>(SCENE_STORY);
+    if (scene.count(SCENE_STORY) >= 2) {
+        if (!sceneObjectFinite(story[0]) || !sceneObjectFinite(story[1])) {
+            std::cout << "Scene story objects have a bad position or scale in " << path << std::endl;
+            return false;
+        }
+        boatStartX = story[0].x;
+        boatStartY = story[0].y;
+        icebergX = story[1].x;
+        icebergY = story[1].y;
+        icebergZoomFactor = std::min(5.0f, std::max(0.1f, story[1].scale)); // The range the S/W keys allow; bakeIceberg() divides by it
+    }
+    if (scene.count(SCENE_CLOUD_SHAPES) > 0) {
+        const SceneCloudShape* shapes = scene.records<SceneCloudShape>(SCENE_CLOUD_SHAPES);
+        const CloudPuff* puffs = scene.records<CloudPuff>(SCENE_CLOUD_PUFFS);
+        cloudShapes.clear();
+        for (std::uint32_t i = 0; i < scene.count(SCENE_CLOUD_SHAPES); i++) {
+            if ((std::uint64_t)shapes[i].firstPuff + shapes[i].puffCount > scene.count(SCENE_CLOUD_PUFFS)) {
+                std::cout << "Scene cloud shape " << i << " is out of range in " << path << std::endl;
+                return false;
+            }
+            cloudShapes.push_back({ shapes[i].x, shapes[i].y, shapes[i].z, std::vector<CloudPuff>(puffs + shapes[i].firstPuff, puffs + shapes[i].firstPuff + shapes[i].puffCount) });
+        }
+    }
+    const SceneObject* clouds = scene.records<SceneObject>(SCENE_CLOUDS);
+    for (std::uint32_t i = 0; i < scene.count(SCENE_CLOUDS); i++) {
+        if (clouds[i].shape >= cloudShapes.size()) {
+            std::cout << "Scene cloud " << i << " has no shape " << clouds[i].shape << " in " << path << std::endl;
+            return false;
+        }
+    }
+    if (scene.hasFleet()) worldWidth = std::max(3.0f, header->worldWidth);
+
+    scene.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Scene " << path << ": " << scene.count(SCENE_MESHES) << " meshes, " << scene.count(SCENE_CLOUDS) << " clouds, "
+        << scene.count(SCENE_FLEET_BOATS) << " fleet boats, " << scene.count(SCENE_FLEET_ICEBERGS) << " fleet icebergs (" << scene.size << " bytes, opened in "
+        << scene.loadMs << " ms)" << std::endl;
+    return true;
+}
+
+// The mesh of that name in the scene file, nullptr when it has none (the built-in one is used)
+const SceneMeshRecord* findSceneMesh(const char* name) {
+    const SceneMeshRecord* meshes = scene.records<SceneMeshRecord>(SCENE_MESHES);
+    for (std::uint32_t i = 0; i < scene.count(SCENE_MESHES); i++) {
+        if (std::strcmp(meshes[i].name, name) == 0) return &meshes[i];
+    }
+    return nullptr;
+}
+
+// --- Fleet mode (instanced rendering load test) ---
+
+// Per-instance data streamed to the GPU once per frame in fleet mode
+struct InstanceData {
+    float offset[2];  // Position of the object's base
+    float scale[2];   // X/Y scale (iceberg zoom, smaller fleet boats)
+    float color[3];   // Tint multiplied with the mesh's vertex colors
+    float sinkOffset; // How far the object has sunk below its base
+};
+
+bool fleetMode = false;       // Enabled with --fleet <boats> <icebergs>
+int fleetBoatCount = 0;          // Boats 1..fleetBoatCount in the boat store
+int fleetIcebergCount = 0;
+bool useInstancing = true;    // 'I' toggles one draw per instance, for comparison
+
+std::vector<InstanceData> fleetBoatInstanceData; // Rebuilt every frame from the boat store, visible boats only
+std::vector<InstanceData> fleetIcebergs;
+std::vector<InstanceData> visibleFleetIcebergs;  // Rebuilt every frame from the icebergs the camera sees
+std::vector<int> visibleFleetBoats;              // Fleet boat indices in the cells the camera sees
+
+LooseGrid fleetIcebergGrid; // Fleet iceberg i at its base
+
+GLuint instancedProgram = 0;     // The uber-shader's lit, instanced permutation
+GLuint fleetBoatInstances = 0;   // Instance buffers, re-filled every frame
+GLuint fleetIcebergInstances = 0;
+GLuint fleetBoatVertexArray = 0; // Mesh + instance attribute bindings
+GLuint fleetIcebergVertexArray = 0;
+
+// Attribute locations shared by the uber-shader and its vertex arrays
+enum InstancedAttribute {
+    ATTRIB_POSITION = 0,
+    ATTRIB_NORMAL = 1,
+    ATTRIB_COLOR = 2,
+    ATTRIB_INSTANCE_TRANSFORM = 3, // offset.xy, scale.xy
+    ATTRIB_INSTANCE_COLOR = 4      // tint.rgb, sink offset
+};
+
+// Compile one shader stage; header (optional) goes in front of the source, for #version and
+// #define lines. Returns 0 and prints the log on failure.
+GLuint compileShader(GLenum stage, const char* source, const char* header = "") {
+    GLuint shader = glCreateShader(stage);
+    const char* sources[2] = { header, source };
+    glShaderSource(shader, 2, sources, nullptr);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        std::cout << "Shader compile error: " << log << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+// Compile and link a vertex + fragment shader pair; bindAttributes (optional) runs before linking
+// to fix attribute locations, header is passed to compileShader(). Returns 0 and prints the log on failure.
+GLuint createProgram(const char* vertexSource, const char* fragmentSource, const std::function<void(GLuint)>& bindAttributes = nullptr, const char* header = "") {
+    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource, header);
+    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource, header);
+    if (!vertexShader || !fragmentShader) return 0;
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    if (bindAttributes) bindAttributes(program);
+    glLinkProgram(program);
+    glDeleteShader(vertexShader); // Flagged for deletion, freed together with the program
+    glDeleteShader(fragmentShader);
+
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        char log[1024];
+        glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+        std::cout << "Shader link error: " << log << std::endl;
+        return 0;
+    }
+    return program;
+}
+
+// Vertex array reading the mesh's interleaved vertices as generic attributes, plus one
+// InstanceData per instance when instanceBuffer is given
+GLuint createInstancedVertexArray(const Mesh& mesh, GLuint instanceBuffer) {
+    GLuint vertexArray = 0;
+    glGenVertexArrays(1, &vertexArray);
+    glBindVertexArray(vertexArray);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+    glEnableVertexAttribArray(ATTRIB_POSITION);
+    glEnableVertexAttribArray(ATTRIB_NORMAL);
+    glEnableVertexAttribArray(ATTRIB_COLOR);
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, position));
+    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, normal));
+    glVertexAttribPointer(ATTRIB_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (const void*)offsetof(MeshVertex, color));
+
+    if (instanceBuffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glEnableVertexAttribArray(ATTRIB_INSTANCE_TRANSFORM);
+        glEnableVertexAttribArray(ATTRIB_INSTANCE_COLOR);
+        glVertexAttribPointer(ATTRIB_INSTANCE_TRANSFORM, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)offsetof(InstanceData, offset));
+        glVertexAttribPointer(ATTRIB_INSTANCE_COLOR, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (const void*)offsetof(InstanceData, color));
+        glVertexAttribDivisor(ATTRIB_INSTANCE_TRANSFORM, 1); // Advance once per instance, not per vertex
+        glVertexAttribDivisor(ATTRIB_INSTANCE_COLOR, 1);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return vertexArray;
+}
+
+// --- Shader renderer (--shaders) ---
+// Per-pixel lighting equivalent to the fixed-function GL_LIGHT0 setup (positional light,
+// ambient + diffuse + Blinn specular, colour material for ambient and diffuse). One source,
+// specialised by #define: LIT (lighting or plain vertex colour) and INSTANCED (transform from
+// per-instance attributes or from the per-draw uniforms). The light and the material come from
+// uniform buffers, filled once per frame and once at startup.
+
+// std140 layouts of the uniform blocks
+struct FrameUniforms {
+    float projection[16];
+    float view[16];
+    float lightPosition[4]; // Eye space
+    float lightAmbient[4];
+    float lightDiffuse[4];
+    float lightSpecular[4];
+    float sceneAmbient[4];
+};
+
+struct MaterialUniforms {
+    float specular[4];
+    float shininess;
+    float padding[3];
+};
+
+enum UniformBinding { UNIFORMS_FRAME = 0, UNIFORMS_MATERIAL = 1 };
+GLuint frameUniformBuffer = 0;
+GLuint materialUniformBuffer = 0;
+
+const char* uberShaderBlocks = R"(
+layout(std140) uniform Frame {
+    mat4 projection;
+    mat4 view;
+    vec4 lightPosition;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+    vec4 sceneAmbient;
+};
+layout(std140) uniform Material {
+    vec4 materialSpecular;
+    float shininess;
+};
+)";
+
+const char* uberVertexShader = R"(
+in vec3 position;
+in vec3 normal;
+in vec3 color;
+#ifdef INSTANCED
+in vec4 instanceTransform; // offset.xy, scale.xy
+in vec4 instanceColor;     // tint.rgb, sink offset
+#else
+uniform vec4 modelOffset;  // xyz
+uniform vec4 modelScale;   // xyz
+uniform vec4 modelTint;    // rgb
+#endif
+out vec3 baseColor;
+#ifdef LIT
+out vec3 eyePosition;
+out vec3 eyeNormal;
+#endif
+
+void main() {
+#ifdef INSTANCED
+    vec3 p = vec3(position.xy * instanceTransform.zw + instanceTransform.xy, position.z);
+    p.y -= instanceColor.a;
+    vec3 scale = vec3(instanceTransform.zw, 1.0);
+    baseColor = color * instanceColor.rgb;
+#else
+    vec3 p = position * modelScale.xyz + modelOffset.xyz;
+    vec3 scale = modelScale.xyz;
+    baseColor = color * modelTint.rgb;
+#endif
+    vec4 eye = view * vec4(p, 1.0);
+#ifdef LIT
+    eyePosition = eye.xyz;
+    eyeNormal = mat3(view) * (normal / scale);
+#endif
+    gl_Position = projection * eye;
+}
+)";
+
+const char* uberFragmentShader = R"(
+in vec3 baseColor;
+#ifdef LIT
+in vec3 eyePosition;
+in vec3 eyeNormal;
+#endif
+out vec4 fragColor;
+
+void main() {
+#ifdef LIT
+    vec3 n = normalize(eyeNormal);
+    vec3 toLight = normalize(lightPosition.xyz - eyePosition);
+    float diffuse = max(dot(n, toLight), 0.0);
+    float specular = 0.0;
+    if (diffuse > 0.0) {
+        vec3 halfVector = normalize(toLight + vec3(0.0, 0.0, 1.0)); // Infinite viewer, as GL_LIGHT_MODEL_LOCAL_VIEWER is off
+        specular = pow(max(dot(n, halfVector), 0.0), shininess);
+    }
+    vec3 lit = baseColor * (sceneAmbient.rgb + lightAmbient.rgb)
+             + baseColor * diffuse * lightDiffuse.rgb
+             + specular * lightSpecular.rgb * materialSpecular.rgb;
+    fragColor = vec4(min(lit, 1.0), 1.0);
+#else
+    fragColor = vec4(baseColor, 1.0);
+#endif
+}
+)";
+
+// Compile one permutation of the uber-shader and hook its blocks up to the shared buffers
+GLuint createUberProgram(int permutation) {
+    std::string header = "#version 140\n";
+    if (permutation & SHADER_LIT) header += "#define LIT\n";
+    if (permutation & SHADER_INSTANCED) header += "#define INSTANCED\n";
+    header += uberShaderBlocks;
+    GLuint program = createProgram(uberVertexShader, uberFragmentShader, [](GLuint program) {
+        glBindAttribLocation(program, ATTRIB_POSITION, "position");
+        glBindAttribLocation(program, ATTRIB_NORMAL, "normal");
+        glBindAttribLocation(program, ATTRIB_COLOR, "color");
+        glBindAttribLocation(program, ATTRIB_INSTANCE_TRANSFORM, "instanceTransform");
+        glBindAttribLocation(program, ATTRIB_INSTANCE_COLOR, "instanceColor");
+    }, header.c_str());
+    if (!program) return 0;
+    GLuint frameBlock = glGetUniformBlockIndex(program, "Frame");
+    GLuint materialBlock = glGetUniformBlockIndex(program, "Material");
+    if (frameBlock != GL_INVALID_INDEX) glUniformBlockBinding(program, frameBlock, UNIFORMS_FRAME);
+    if (materialBlock != GL_INVALID_INDEX) glUniformBlockBinding(program, materialBlock, UNIFORMS_MATERIAL); // Unlit permutations don't use it
+    uberModelOffset[permutation] = glGetUniformLocation(program, "modelOffset");
+    uberModelScale[permutation] = glGetUniformLocation(program, "modelScale");
+    uberModelTint[permutation] = glGetUniformLocation(program, "modelTint");
+    if (uberModelTint[permutation] >= 0) {
+        glUseProgram(program);
+        glUniform4f(uberModelTint[permutation], 1.0f, 1.0f, 1.0f, 1.0f);
+        glUseProgram(0);
+    }
+    return program;
+}
+
+// The frame and material uniform buffers every permutation reads; created once, by the shader
+// renderer or by fleet mode
+void createUniformBuffers() {
+    if (frameUniformBuffer) return;
+    glGenBuffers(1, &frameUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    MaterialUniforms material = {};
+    std::memcpy(material.specular, materialSpecular, sizeof(material.specular));
+    material.shininess = materialShininess;
+    glGenBuffers(1, &materialUniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, materialUniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(MaterialUniforms), &material, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORMS_FRAME, frameUniformBuffer);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORMS_MATERIAL, materialUniformBuffer);
+}
+
+// Build every permutation, the uniform buffers and a generic-attribute vertex array per mesh.
+// Leaves useShaderRenderer off (fixed-function lighting) when any of it is unsupported.
+void initShaderRenderer() {
+    if (!useShaderRenderer) return;
+    useShaderRenderer = false;
+    if (!useRetainedMeshes || !glGenVertexArrays || !glCreateShader || !glGetUniformBlockIndex || !glUniformBlockBinding || !glBindBufferBase || !glUniform4f) {
+        std::cout << "Shader renderer not supported, using fixed-function lighting." << std::endl;
+        return;
+    }
+    for (int permutation = 0; permutation < SHADER_PERMUTATIONS; permutation++) {
+        if ((permutation & SHADER_INSTANCED) && !glVertexAttribDivisor) continue; // Only needed by fleet mode
+        uberPrograms[permutation] = createUberProgram(permutation);
+        if (!uberPrograms[permutation] && !(permutation & SHADER_INSTANCED)) {
+            std::cout << "Shader renderer unavailable, using fixed-function lighting." << std::endl;
+            return;
+        }
+    }
+
+    createUniformBuffers();
+    for (Mesh* mesh : { &boatMesh, &icebergMesh, &icebergCrackMesh, &skyMesh, &sunMesh, &waterMesh, &waveMesh, &cloudLayer.spheres[0], &cloudLayer.spheres[1], &cloudLayer.spheres[2] }) {
+        mesh->attributeArray = createInstancedVertexArray(*mesh, 0);
+    }
+    useShaderRenderer = true;
+    std::cout << "Shader renderer: per-pixel lighting" << std::endl;
+}
+
+// Upload this frame's matrices and light; called after the modelview matrix and the fixed-function
+// light have been set, so both renderers (and the fleet's shaders) see the same values
+void updateFrameUniforms(const GLfloat lightPosition[4]) {
+    if (!frameUniformBuffer) return;
+    FrameUniforms frame;
+    glGetFloatv(GL_PROJECTION_MATRIX, frame.projection);
+    glGetFloatv(GL_MODELVIEW_MATRIX, frame.view);
+    for (int row = 0; row < 4; row++) { // Light into eye space, as glLightfv() does
+        frame.lightPosition[row] = 0.0f;
+        for (int column = 0; column < 4; column++) frame.lightPosition[row] += frame.view[column * 4 + row] * lightPosition[column];
+    }
+    std::memcpy(frame.lightAmbient, lightAmbient, sizeof(frame.lightAmbient));
+    std::memcpy(frame.lightDiffuse, lightDiffuse, sizeof(frame.lightDiffuse));
+    std::memcpy(frame.lightSpecular, lightSpecular, sizeof(frame.lightSpecular));
+    std::memcpy(frame.sceneAmbient, sceneAmbient, sizeof(frame.sceneAmbient));
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUniformBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(frame), &frame);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Scatter the fleet over the world strip with a fixed seed so runs are repeatable
+void scatterFleet() {
+    float halfWidth = worldWidth * 0.5f;
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> across(-halfWidth, halfWidth);
+    std::uniform_real_distribution<float> depth(-0.9f, 0.05f);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // Fleet boats patrol between the two edges of the strip
+    for (int i = 0; i < fleetBoatCount; i++) {
+        float startX = across(rng);
+        float startY = depth(rng);
+        float speed = 0.12f + 0.36f * unit(rng);
+        int boat = boats.add(startX, startY, speed, 0.25f, BOAT_VISIBLE | BOAT_MOVING | BOAT_PATROL); // Smaller than the story boat
+        float edge = unit(rng) < 0.5f ? -halfWidth : halfWidth;
+        boats.targetX[boat] = edge;
+        boats.patrolX[boat] = -edge;
+        for (int c = 0; c < 3; c++) boats.tint[boat * 3 + c] = 0.6f + 0.4f * unit(rng);
+    }
+
+    fleetIcebergs.resize(fleetIcebergCount);
+    for (int i = 0; i < fleetIcebergCount; i++) {
+        InstanceData& iceberg = fleetIcebergs[i];
+        iceberg.offset[0] = across(rng);
+        iceberg.offset[1] = depth(rng);
+        iceberg.scale[0] = iceberg.scale[1] = 0.3f + 0.5f * unit(rng);
+        iceberg.color[0] = iceberg.color[1] = iceberg.color[2] = 1.0f;
+        iceberg.sinkOffset = 0.0f;
+    }
+}
+
+// The fleet stored in the scene file; boats patrol between their target and its mirror image
+void loadSceneFleet() {
+    const SceneObject* fleetBoats = scene.records<SceneObject>(SCENE_FLEET_BOATS);
+    for (int i = 0; i < fleetBoatCount; i++) {
+        const SceneObject& record = fleetBoats[i];
+        int boat = boats.add(record.x, record.y, record.speed, record.scale, BOAT_VISIBLE | BOAT_MOVING | BOAT_PATROL);
+        boats.targetX[boat] = record.targetX;
+        boats.patrolX[boat] = -record.targetX;
+        std::memcpy(&boats.tint[boat * 3], record.color, sizeof(record.color));
+    }
+    const SceneObject* icebergs = scene.records<SceneObject>(SCENE_FLEET_ICEBERGS);
+    fleetIcebergs.resize(fleetIcebergCount);
+    for (int i = 0; i < fleetIcebergCount; i++) {
+        InstanceData& iceberg = fleetIcebergs[i];
+        iceberg.offset[0] = icebergs[i].x;
+        iceberg.offset[1] = icebergs[i].y;
+        iceberg.scale[0] = iceberg.scale[1] = icebergs[i].scale;
+        std::memcpy(iceberg.color, icebergs[i].color, sizeof(iceberg.color));
+        iceberg.sinkOffset = 0.0f;
+    }
+}
+
+// The scene file's fleet replaces --fleet
+void useSceneFleet() {
+    if (!scene.hasFleet()) return;
+    fleetMode = true;
+    fleetBoatCount = (int)scene.count(SCENE_FLEET_BOATS);
+    fleetIcebergCount = (int)scene.count(SCENE_FLEET_ICEBERGS);
+}
+
+// Fill the boat store and the iceberg instances, then bin both for culling
+void createFleet() {
+    float halfWidth = worldWidth * 0.5f;
+    if (scene.hasFleet()) loadSceneFleet();
+    else scatterFleet();
+
+    // Boats reach 0.25 of their scale left of their base point (plus the ocean's bob), icebergs 0.2 above it
+    fleetBoatGrid.reset(-halfWidth, -1.0f, halfWidth, horizonY, 0.5f);
+    fleetIcebergGrid.reset(-halfWidth, -1.0f, halfWidth, horizonY, 0.5f);
+    for (int i = 0; i < fleetBoatCount; i++) fleetBoatGrid.insert(i, boats.x[1 + i], boats.baseY[1 + i], 0.25f * boats.scale[1 + i] + 0.03f);
+    for (int i = 0; i < fleetIcebergCount; i++) fleetIcebergGrid.insert(i, fleetIcebergs[i].offset[0], fleetIcebergs[i].offset[1], 0.2f * fleetIcebergs[i].scale[1]);
+}
+
+// Re-bin the fleet boats that moved this tick (x is all that changes their cell; baseY is fixed).
+// Runs on the simulation, so drawing never pays for boats it doesn't see.
+void rebinFleetBoats() {
+    if (!fleetMode) return;
+    PROFILE_SCOPE("rebinFleetBoats");
+    for (int i = 0; i < fleetBoatCount; i++) {
+        int boat = 1 + i;
+        if (boats.x[boat] != boats.prevX[boat]) fleetBoatGrid.move(i, boats.x[boat], boats.baseY[boat]);
+    }
+}
+
+// Set up the fleet and its GPU resources; fleet mode is turned off if instancing is unsupported
+void initFleet() {
+    useSceneFleet();
+    if (!fleetMode) return;
+    if (!glDrawElementsInstanced || !glVertexAttribDivisor || !glGenVertexArrays || !glCreateShader || !glGetUniformBlockIndex
+        || !glUniformBlockBinding || !glBindBufferBase || !glUniform4f || !boatMesh.vertexBuffer) {
+        std::cout << "Instanced rendering not supported, fleet mode disabled." << std::endl;
+        fleetMode = false;
+        return;
+    }
+    // The fleet is lit by the uber-shader on either renderer: instanced, or one draw per instance
+    // ('I') with the per-draw permutation, so both show the same pixels. Without --shaders only
+    // those two permutations are built, and only the fleet meshes get attribute arrays.
+    if (!useShaderRenderer) {
+        for (int permutation : { (int)SHADER_LIT, SHADER_LIT | SHADER_INSTANCED }) uberPrograms[permutation] = createUberProgram(permutation);
+        if (uberPrograms[SHADER_LIT]) {
+            createUniformBuffers();
+            boatMesh.attributeArray = createInstancedVertexArray(boatMesh, 0);
+            icebergMesh.attributeArray = createInstancedVertexArray(icebergMesh, 0);
+        }
+    }
+    instancedProgram = uberPrograms[SHADER_LIT | SHADER_INSTANCED];
+    if (!instancedProgram || !uberPrograms[SHADER_LIT]) {
+        std::cout << "Fleet shaders unavailable, fleet mode disabled." << std::endl;
+        fleetMode = false;
+        return;
+    }
+
+    createFleet();
+    glGenBuffers(1, &fleetBoatInstances);
+    glGenBuffers(1, &fleetIcebergInstances);
+    fleetBoatVertexArray = createInstancedVertexArray(boatMesh, fleetBoatInstances);
+    fleetIcebergVertexArray = createInstancedVertexArray(icebergMesh, fleetIcebergInstances);
+    std::cout << "Fleet mode: " << fleetBoatCount << " boats, " << fleetIcebergCount << " icebergs." << std::endl;
+}
+
+bool simulationThreadRunning();
+
+// Copy the state of the boats and icebergs the camera sees into the instance layout. The boat
+// grid was re-binned by the simulation (rebinFleetBoats()), so only the visible cells are touched.
+// While the simulation has its own thread the worker pool is its, so the copy runs inline here
+// and never waits for a tick's parallelFor().
+void fillFleetInstances() {
+    const BoatStore& drawn = drawnBoats();
+    ViewRect view = cameraView();
+    visibleFleetBoats.clear();
+    frameCounters.objectsVisited += drawnFleetBoatGrid().query(view, [](int i) { visibleFleetBoats.push_back(i); });
+    visibleFleetIcebergs.clear();
+    frameCounters.objectsVisited += fleetIcebergGrid.query(view, [](int i) { visibleFleetIcebergs.push_back(fleetIcebergs[i]); });
+
+    fleetBoatInstanceData.resize(visibleFleetBoats.size());
+    auto fill = [&drawn](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int boat = 1 + visibleFleetBoats[i];
+            InstanceData& instance = fleetBoatInstanceData[i];
+            instance.offset[0] = drawn.renderX(boat);
+            instance.offset[1] = drawn.baseY[boat];
+            instance.scale[0] = instance.scale[1] = drawn.scale[boat];
+            std::memcpy(instance.color, &drawn.tint[boat * 3], sizeof(instance.color));
+            instance.sinkOffset = drawn.baseY[boat] - drawn.renderY(boat);
+        }
+    };
+    if (simulationThreadRunning()) fill(0, (int)visibleFleetBoats.size());
+    else workers.parallelFor((int)visibleFleetBoats.size(), boatUpdateChunk, fill);
+}
+
+// Stream the instance data and draw every instance of a mesh in one call
+void drawInstances(const Mesh& mesh, GLuint vertexArray, GLuint instanceBuffer, const std::vector<InstanceData>& instances) {
+    if (instances.empty()) return;
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    // Orphan last frame's storage so the driver doesn't wait for draws still reading it
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(InstanceData), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), instances.data());
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glBindVertexArray(vertexArray);
+    glDrawElementsInstanced(mesh.primitive, mesh.indexCount, GL_UNSIGNED_SHORT, nullptr, (GLsizei)instances.size());
+    countDraw((long long)mesh.indexCount * (long long)instances.size());
+    glBindVertexArray(0);
+}
+
+// Reference path: one draw call per instance, with the transform and tint set as uniforms of
+// the same shader the instanced draws use
+void drawInstancesOneByOne(const Mesh& mesh, const std::vector<InstanceData>& instances) {
+    glUseProgram(uberPrograms[SHADER_LIT]);
+    glBindVertexArray(mesh.attributeArray);
+    for (const InstanceData& instance : instances) {
+        glUniform4f(uberModelOffset[SHADER_LIT], instance.offset[0], instance.offset[1] - instance.sinkOffset, 0.0f, 0.0f);
+        glUniform4f(uberModelScale[SHADER_LIT], instance.scale[0], instance.scale[1], 1.0f, 0.0f);
+        glUniform4f(uberModelTint[SHADER_LIT], instance.color[0], instance.color[1], instance.color[2], 1.0f);
+        glDrawElements(mesh.primitive, mesh.indexCount, GL_UNSIGNED_SHORT, nullptr);
+        countDraw(mesh.indexCount);
+    }
+    glUniform4f(uberModelTint[SHADER_LIT], 1.0f, 1.0f, 1.0f, 1.0f);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+// Draw the fleet boats and icebergs in view
+void drawFleet() {
+    if (!fleetMode) return;
+    PROFILE_GPU_SCOPE("drawFleet");
+    fillFleetInstances();
+    if (!useInstancing) {
+        drawInstancesOneByOne(icebergMesh, visibleFleetIcebergs);
+        drawInstancesOneByOne(boatMesh, fleetBoatInstanceData);
+        return;
+    }
+    glUseProgram(instancedProgram);
+    drawInstances(icebergMesh, fleetIcebergVertexArray, fleetIcebergInstances, visibleFleetIcebergs);
+    drawInstances(boatMesh, fleetBoatVertexArray, fleetBoatInstances, fleetBoatInstanceData);
+    glUseProgram(0);
+}
+
+// Function to draw a circle/filled polygon (for sun - no longer used for clouds)
+void drawCircle(float cx, float cy, float r, int num_segments) {
+    glBegin(GL_TRIANGLE_FAN);
+    glVertex3f(cx, cy, 0.0f); // Center of circle, now with Z=0
+    for (int i = 0; i <= num_segments; i++) {
+        float theta = 2.0f * 3.1415926f * float(i) / float(num_segments); // Get the current angle
+        float x = r * cosf(theta); // Calculate the x component
+        float y = r * sinf(theta); // Calculate the y component
+        glVertex3f(cx + x, cy + y, 0.0f); // Output vertex, now with Z=0
+    }
+    glEnd();
+    countDraw(num_segments + 2);
+}
+
+// Lit sphere. Uses glutSolidSphere in a window; the headless path has no GLUT, so it draws
+// an equivalent stack-by-stack tessellation itself. Counted as GLUT submits it: one strip per stack.
+void solidSphere(double radius, int slices, int stacks) {
+    countDraw(stacks, (long long)stacks * (slices + 1) * 2);
+    if (!headlessMode) {
+        glutSolidSphere(radius, slices, stacks);
+        return;
+    }
+    const float pi = 3.1415926f;
+    for (int i = 0; i < stacks; i++) {
+        float phi0 = pi * i / stacks;
+        float phi1 = pi * (i + 1) / stacks;
+        glBegin(GL_QUAD_STRIP);
+        for (int j = 0; j <= slices; j++) {
+            float theta = 2.0f * pi * j / slices;
+            float n0[3] = { cosf(theta) * sinf(phi0), sinf(theta) * sinf(phi0), cosf(phi0) };
+            float n1[3] = { cosf(theta) * sinf(phi1), sinf(theta) * sinf(phi1), cosf(phi1) };
+            glNormal3fv(n1);
+            glVertex3f(n1[0] * (float)radius, n1[1] * (float)radius, n1[2] * (float)radius);
+            glNormal3fv(n0);
+            glVertex3f(n0[0] * (float)radius, n0[1] * (float)radius, n0[2] * (float)radius);
+        }
+        glEnd();
+    }
+}
+
+// Draw the sky with a gradient
+void drawSky() {
+    PROFILE_GPU_SCOPE("drawSky");
+    // Disable lighting temporarily for background elements that shouldn't be lit
+    glDisable(GL_LIGHTING);
+    glBegin(GL_QUADS);
+    // Top (lighter blue)
+    glColor3f(0.7f, 0.9f, 1.0f); // Lighter blue at the top
+    glVertex3f(-1.5f, 1.0f, -0.9f); // Placed far back in Z
+    glVertex3f(1.5f, 1.0f, -0.9f);
+
+    // Bottom (slightly darker blue, above water horizon)
+    glColor3f(0.4f, 0.7f, 1.0f); // Darker blue towards the horizon
+    glVertex3f(1.5f, 0.1f, -0.9f);
+    glVertex3f(-1.5f, 0.1f, -0.9f);
+    glEnd();
+    countDraw(4);
+    glEnable(GL_LIGHTING); // Re-enable lighting
+}
+
+// Draw the sun with a glow (visual representation only)
+void drawSun() {
+    PROFILE_GPU_SCOPE("drawSun");
+    glDisable(GL_LIGHTING); // Sun is a light source, but its visual representation doesn't need to be lit itself
+    glPushMatrix();
+    glTranslatef(sunLightX, sunLightY, sunLightZ - 0.2f); // Position of the sun visually, slightly behind light source actual Z
+    // Draw the glow
+    glColor3f(1.0f, 0.7f, 0.0f); // Orange glow
+    drawCircle(0.0f, 0.0f, 0.18f, 30);
+
+    // Draw the sun core
+    glColor3f(1.0f, 0.9f, 0.0f); // Yellow core
+    drawCircle(0.0f, 0.0f, 0.15f, 30);
+    glPopMatrix();
+    glEnable(GL_LIGHTING); // Re-enable lighting
+}
+
+// The original clouds (or the scene file's), plus --clouds extra ones scattered over the sky with a fixed seed
+void createClouds() {
+    const SceneObject* sceneClouds = scene.records<SceneObject>(SCENE_CLOUDS);
+    for (std::uint32_t i = 0; i < scene.count(SCENE_CLOUDS); i++) {
+        cloudLayer.clouds.push_back({ (int)sceneClouds[i].shape, sceneClouds[i].x, sceneClouds[i].y, sceneClouds[i].z, sceneClouds[i].scale });
+    }
+    for (int shape = 0; shape < (int)cloudShapes.size() && !scene.loaded(); shape++) {
+        cloudLayer.clouds.push_back({ shape, cloudShapes[shape].x, cloudShapes[shape].y, cloudShapes[shape].z, 1.0f });
+    }
+    std::mt19937 rng(4321);
+    std::uniform_int_distribution<int> shape(0, (int)cloudShapes.size() - 1);
+    std::uniform_real_distribution<float> across(-1.6f, 1.6f);
+    std::uniform_real_distribution<float> height(0.3f, 1.0f);
+    std::uniform_real_distribution<float> depth(-0.85f, -0.3f);
+    std::uniform_real_distribution<float> scale(0.15f, 0.8f);
+    for (int i = 0; i < cloudLayer.extraClouds; i++) {
+        cloudLayer.clouds.push_back({ shape(rng), across(rng), height(rng), depth(rng), scale(rng) });
+    }
+}
+
+// Draw every cloud with full-detail spheres, re-tessellated on each call
+void drawClouds() {
+    PROFILE_GPU_SCOPE("drawClouds");
+    glEnable(GL_LIGHTING); // Re-enable lighting for clouds as they are now 3D objects
+    glColor3f(1.0f, 1.0f, 1.0f); // White color for clouds
+    for (const Cloud& cloud : cloudLayer.clouds) {
+        for (const CloudPuff& puff : cloudShapes[cloud.shape].puffs) {
+            glPushMatrix();
+            glTranslatef(cloud.x + puff.x * cloud.scale, cloud.y + puff.y * cloud.scale, cloud.z + puff.z * cloud.scale);
+            solidSphere(puff.radius * cloud.scale, 20, 20);
+            glPopMatrix();
+        }
+    }
+    // No glDisable(GL_LIGHTING) at the end, as clouds are now lit 3D objects
+}
+
+// Draw the water layer with subtle waves
+void drawWater() {
+    PROFILE_GPU_SCOPE("drawWater");
+    glColor3f(0.0f, 0.5f, 1.0f); // Blue color for water (will be modulated by lighting)
+    glBegin(GL_QUADS);
+    glNormal3f(0.0f, 0.0f, 1.0f); // Normal pointing out of the screen (for flat surface)
+    glVertex3f(-1.5f, -1.0f, 0.0f); // Bottom-left corner of water
+    glVertex3f(1.5f, -1.0f, 0.0f);  // Bottom-right corner of water
+    glVertex3f(1.5f, 0.1f, 0.0f);   // Top-right corner of water
+    glVertex3f(-1.5f, 0.1f, 0.0f);  // Top-left corner of water
+    glEnd();
+    countDraw(4);
+
+    // Draw subtle waves on top of the water (might look better without lighting or with specific material)
+    glDisable(GL_LIGHTING); // Temporarily disable lighting for wave lines
+    glColor3f(0.8f, 0.9f, 1.0f); // Light blue/white for waves
+    glBegin(GL_LINES);
+    // Line 1
+    glVertex3f(-1.4f, 0.08f, 0.01f); glVertex3f(-1.2f, 0.08f, 0.01f);
+    glVertex3f(-1.1f, 0.06f, 0.01f); glVertex3f(-0.9f, 0.06f, 0.01f);
+    // Line 2
+    glVertex3f(-0.6f, 0.09f, 0.01f); glVertex3f(-0.4f, 0.09f, 0.01f);
+    glVertex3f(-0.3f, 0.07f, 0.01f); glVertex3f(-0.1f, 0.07f, 0.01f);
+    // Line 3
+    glVertex3f(0.2f, 0.08f, 0.01f); glVertex3f(0.4f, 0.08f, 0.01f);
+    glVertex3f(0.5f, 0.06f, 0.01f); glVertex3f(0.7f, 0.06f, 0.01f);
+    // Line 4
+    glVertex3f(0.9f, 0.09f, 0.01f); glVertex3f(1.1f, 0.09f, 0.01f);
+    glEnd();
+    countDraw(14);
+    glEnable(GL_LIGHTING); // Re-enable lighting
+}
+
+
+// Draw the boat (3D)
+void drawBoat() {
+    PROFILE_GPU_SCOPE("drawBoat");
+    const BoatStore& drawn = drawnBoats();
+    if (!drawn.has(storyBoat, BOAT_VISIBLE | BOAT_SINKING)) return; // Hide boat if not visible and not sinking
+    float boatX = drawn.renderX(storyBoat), boatY = drawn.renderY(storyBoat); // Interpolated between ticks
+    if (!cameraSees(boatX - 0.25f, boatY, boatX + 0.2f, boatY + 0.2f)) return; // Scrolled out of view
+    if (useRetainedMeshes) {
+        submitMesh(PASS_WORLD, boatMesh, true, 0.0f, boatX, boatY, 0.0f); // Hull, rudder and sail in one indexed draw call
+        return;
+    }
+
+    glPushMatrix();
+    glTranslatef(boatX, boatY, 0.0f); // Translate boat to its position
+
+    // Define boat hull vertices for a box-like shape
+    // Front face (Z = 0.05)
+    // Back face (Z = -0.05)
+    // Length X: -0.2 to 0.2
+    // Height Y: 0.0 to 0.1 (relative to the boat's base)
+    float hullZFront = 0.05f;
+    float hullZBack = -0.05f;
+    float hullHeight = 0.1f;
+
+    // Boat hull (YELLOW)
+    glColor3f(1.0f, 1.0f, 0.0f); // Yellow color for the boat body
+
+    // Top Face (GL_QUADS)
+    glBegin(GL_QUADS);
+    glNormal3f(0.0f, 1.0f, 0.0f); // Normal pointing up in Y
+    glVertex3f(-0.2f, hullHeight, hullZFront);
+    glVertex3f(0.2f, hullHeight, hullZFront);
+    glVertex3f(0.2f, hullHeight, hullZBack);
+    glVertex3f(-0.2f, hullHeight, hullZBack);
+    glEnd();
+
+    // Bottom Face (GL_QUADS)
+    glColor3f(0.7f, 0.7f, 0.0f); // Darker yellow for bottom
+    glBegin(GL_QUADS);
+    glNormal3f(0.0f, -1.0f, 0.0f); // Normal pointing down in Y
+    glVertex3f(-0.2f, 0.0f, hullZBack);
+    glVertex3f(0.2f, 0.0f, hullZBack);
+    glVertex3f(0.2f, 0.0f, hullZFront);
+    glVertex3f(-0.2f, 0.0f, hullZFront);
+    glEnd();
+
+    // Front Face (GL_QUADS)
+    glColor3f(1.0f, 1.0f, 0.0f); // Yellow
+    glBegin(GL_QUADS);
+    glNormal3f(0.0f, 0.0f, 1.0f); // Normal pointing out in Z
+    glVertex3f(-0.2f, 0.0f, hullZFront);
+    glVertex3f(0.2f, 0.0f, hullZFront);
+    glVertex3f(0.2f, hullHeight, hullZFront);
+    glVertex3f(-0.2f, hullHeight, hullZFront);
+    glEnd();
+
+    // Back Face (GL_QUADS)
+    glBegin(GL_QUADS);
+    glNormal3f(0.0f, 0.0f, -1.0f); // Normal pointing in negative Z
+    glVertex3f(-0.2f, hullHeight, hullZBack);
+    glVertex3f(0.2f, hullHeight, hullZBack);
+    glVertex3f(0.2f, 0.0f, hullZBack);
+    glVertex3f(-0.2f, 0.0f, hullZBack);
+    glEnd();
+
+    // Right Side Face (GL_QUADS)
+    glBegin(GL_QUADS);
+    glNormal3f(1.0f, 0.0f, 0.0f); // Normal pointing right in X
+    glVertex3f(0.2f, 0.0f, hullZFront);
+    glVertex3f(0.2f, 0.0f, hullZBack);
+    glVertex3f(0.2f, hullHeight, hullZBack);
+    glVertex3f(0.2f, hullHeight, hullZFront);
+    glEnd();
+
+    // Left Side Face (GL_QUADS)
+    glBegin(GL_QUADS);
+    glNormal3f(-1.0f, 0.0f, 0.0f); // Normal pointing left in X
+    glVertex3f(-0.2f, hullHeight, hullZFront);
+    glVertex3f(-0.2f, hullHeight, hullZBack);
+    glVertex3f(-0.2f, 0.0f, hullZBack);
+    glVertex3f(-0.2f, 0.0f, hullZFront);
+    glEnd();
+
+
+    // Red rudder/fin (3D)
+    float rudderZFront = 0.01f; // Thin rudder
+    float rudderZBack = -0.01f;
+    glColor3f(1.0f, 0.0f, 0.0f);
+
+    // Front face of rudder
+    glBegin(GL_TRIANGLES);
+    glNormal3f(0.0f, 0.0f, 1.0f); // Front face normal
+    glVertex3f(-0.2f, 0.1f, rudderZFront);
+    glVertex3f(-0.25f, 0.15f, rudderZFront);
+    glVertex3f(-0.2f, 0.0f, rudderZFront);
+    glEnd();
+
+    // Back face of rudder
+    glBegin(GL_TRIANGLES);
+    glNormal3f(0.0f, 0.0f, -1.0f); // Back face normal
+    glVertex3f(-0.2f, 0.0f, rudderZBack);
+    glVertex3f(-0.25f, 0.15f, rudderZBack);
+    glVertex3f(-0.2f, 0.1f, rudderZBack);
+    glEnd();
+
+    // Side faces of rudder (using QUADS to connect front and back triangles)
+    glBegin(GL_QUADS);
+    // Bottom edge face
+    glNormal3f(0.0f, -1.0f, 0.0f); // Normal points down (approx)
+    glVertex3f(-0.2f, 0.0f, rudderZFront);
+    glVertex3f(-0.2f, 0.0f, rudderZBack);
+    glVertex3f(-0.25f, 0.15f, rudderZBack); // Connects to top point
+    glVertex3f(-0.25f, 0.15f, rudderZFront);
+    glEnd();
+
+    glBegin(GL_QUADS);
+    // Slanted top-front edge face
+    glNormal3f(0.707f, 0.707f, 0.0f); // Normal roughly points up-right
+    glVertex3f(-0.2f, 0.1f, rudderZFront);
+    glVertex3f(-0.2f, 0.1f, rudderZBack);
+    glVertex3f(-0.25f, 0.15f, rudderZBack);
+    glVertex3f(-0.25f, 0.15f, rudderZFront);
+    glEnd();
+
+    glBegin(GL_QUADS);
+    // Vertical back-edge face
+    glNormal3f(-1.0f, 0.0f, 0.0f); // Normal points left (approx)
+    glVertex3f(-0.2f, 0.0f, rudderZFront);
+    glVertex3f(-0.2f, 0.1f, rudderZFront);
+    glVertex3f(-0.2f, 0.1f, rudderZBack);
+    glVertex3f(-0.2f, 0.0f, rudderZBack);
+    glEnd();
+
+
+    // Gray sail/wing on top (3D)
+    float sailZFront = 0.01f; // Thin sail
+    float sailZBack = -0.01f;
+    glColor3f(0.3f, 0.3f, 0.3f);
+
+    // Front face of sail
+    glBegin(GL_TRIANGLES);
+    glNormal3f(0.0f, 0.0f, 1.0f); // Front face normal
+    glVertex3f(-0.05f, 0.1f, sailZFront);
+    glVertex3f(0.05f, 0.1f, sailZFront);
+    glVertex3f(0.0f, 0.2f, sailZFront);
+    glEnd();
+
+    // Back face of sail
+    glBegin(GL_TRIANGLES);
+    glNormal3f(0.0f, 0.0f, -1.0f); // Back face normal
+    glVertex3f(0.0f, 0.2f, sailZBack);
+    glVertex3f(0.05f, 0.1f, sailZBack);
+    glVertex3f(-0.05f, 0.1f, sailZBack);
+    glEnd();
+
+    // Side faces of sail (using QUADS)
+    glBegin(GL_QUADS);
+    // Left edge face
+    glNormal3f(-0.5f, 0.5f, 0.0f); // Normal points left-up
+    glVertex3f(-0.05f, 0.1f, sailZFront);
+    glVertex3f(-0.05f, 0.1f, sailZBack);
+    glVertex3f(0.0f, 0.2f, sailZBack);
+    glVertex3f(0.0f, 0.2f, sailZFront);
+    glEnd();
+
+    glBegin(GL_QUADS);
+    // Right edge face
+    glNormal3f(0.5f, 0.5f, 0.0f); // Normal points right-up
+    glVertex3f(0.0f, 0.2f, sailZFront);
+    glVertex3f(0.0f, 0.2f, sailZBack);
+    glVertex3f(0.05f, 0.1f, sailZBack);
+    glVertex3f(0.05f, 0.1f, sailZFront);
+    glEnd();
+
+    glBegin(GL_QUADS);
+    // Bottom edge face
+    glNormal3f(0.0f, -1.0f, 0.0f); // Normal points down
+    glVertex3f(-0.05f, 0.1f, sailZFront);
+    glVertex3f(0.05f, 0.1f, sailZFront);
+    glVertex3f(0.05f, 0.1f, sailZBack);
+    glVertex3f(-0.05f, 0.1f, sailZBack);
+    glEnd();
+    countDraw(16, 60); // Immediate-mode hull, rudder and sail: one draw per glBegin/glEnd block
+
+
+    glPopMatrix();
+}
+
+// Draw iceberg (3D)
+void drawIceberg() {
+    PROFILE_GPU_SCOPE("drawIceberg");
+    float zoom = drawnIcebergZoom();
+    if (!cameraSees(icebergX - 0.1f * zoom, icebergY, icebergX + 0.1f * zoom, icebergY + 0.2f * zoom)) return;
+    if (useRetainedMeshes) {
+        if (bakedLightingActive()) submitMesh(PASS_WORLD, bakedLighting.iceberg, false, 0.0f); // Lighting and zoom baked in
+        else submitMesh(PASS_WORLD, icebergMesh, true, 0.0f, icebergX, icebergY, 0.0f, zoom, zoom); // Prism in one indexed draw call
+        submitMesh(PASS_WORLD, icebergCrackMesh, false, 0.0f, icebergX, icebergY, 0.0f, zoom, zoom); // Cracks are unlit lines, as in the immediate path
+        return;
+    }
+
+    glPushMatrix();
+    glTranslatef(icebergX, icebergY, 0.0f); // Translate iceberg to its base position
+    glScalef(zoom, zoom, 1.0f); // Apply zoom to the iceberg
+
+    glColor3f(0.7f, 0.9f, 1.0f); // Light blue/white color for iceberg
+
+    // Draw iceberg as a 3D prism (simple triangular pyramid)
+    // Base triangle on XY plane
+    glBegin(GL_TRIANGLES);
+    glNormal3f(0.0f, 0.0f, 1.0f); // Normal for the top face of the base (facing viewer)
+    glVertex3f(-0.1f, 0.0f, 0.05f); // Base-left point (front)
+    glVertex3f(0.1f, 0.0f, 0.05f);  // Base-right point (front)
+    glVertex3f(0.0f, 0.2f, 0.05f);  // Top point (front)
+    glEnd();
+
+    glBegin(GL_TRIANGLES);
+    glNormal3f(0.0f, 0.0f, -1.0f); // Normal for the back face of the base
+    glVertex3f(0.0f, 0.2f, -0.05f); // Top point (back)
+    glVertex3f(0.1f, 0.0f, -0.05f);  // Base-right point (back)
+    glVertex3f(-0.1f, 0.0f, -0.05f); // Base-left point (back)
+    glEnd();
+
+    // Side faces (connecting front and back triangles)
+    glBegin(GL_QUADS);
+    glNormal3f(-0.8f, 0.0f, 0.5f); // Normal for left slant face
+    glVertex3f(-0.1f, 0.0f, 0.05f);
+    glVertex3f(0.0f, 0.2f, 0.05f);
+    glVertex3f(0.0f, 0.2f, -0.05f);
+    glVertex3f(-0.1f, 0.0f, -0.05f);
+    glEnd();
+
+    glBegin(GL_QUADS);
+    glNormal3f(0.8f, 0.0f, 0.5f); // Normal for right slant face
+    glVertex3f(0.1f, 0.0f, 0.05f);
+    glVertex3f(0.1f, 0.0f, -0.05f);
+    glVertex3f(0.0f, 0.2f, -0.05f);
+    glVertex3f(0.0f, 0.2f, 0.05f);
+    glEnd();
+
+    glBegin(GL_QUADS);
+    glNormal3f(0.0f, -1.0f, 0.0f); // Normal for bottom face
+    glVertex3f(-0.1f, 0.0f, 0.05f);
+    glVertex3f(-0.1f, 0.0f, -0.05f);
+    glVertex3f(0.1f, 0.0f, -0.05f);
+    glVertex3f(0.1f, 0.0f, 0.05f);
+    glEnd();
+
+
+    // Add some cracks/details to the iceberg for more realism
+    glDisable(GL_LIGHTING); // Lines don't interact with lighting in the same way
+    glColor3f(0.5f, 0.7f, 0.8f); // Slightly darker shade for cracks
+    glBegin(GL_LINES);
+    glVertex3f(-0.05f, 0.05f, 0.06f); glVertex3f(0.0f, 0.1f, 0.06f);
+    glVertex3f(0.05f, 0.05f, 0.06f); glVertex3f(0.0f, 0.1f, 0.06f);
+    glVertex3f(0.0f, 0.05f, 0.06f); glVertex3f(0.0f, 0.0f, 0.06f);
+    glEnd();
+    countDraw(6, 24); // Immediate-mode prism (5 faces, 18 vertices) and crack lines (6 vertices)
+    glEnable(GL_LIGHTING);
+
+    glPopMatrix();
+}
+
+// The boat (hull, rudder and sail) as one mesh; same geometry as drawBoat()
+MeshBuilder boatGeometry() {
+    MeshBuilder builder;
+    float hullZFront = 0.05f;
+    float hullZBack = -0.05f;
+    float hullHeight = 0.1f;
+
+    // Boat hull (YELLOW)
+    builder.color(1.0f, 1.0f, 0.0f); // Yellow color for the boat body
+
+    // Top Face (GL_QUADS)
+    builder.begin(GL_QUADS);
+    builder.normal(0.0f, 1.0f, 0.0f); // Normal pointing up in Y
+    builder.vertex(-0.2f, hullHeight, hullZFront);
+    builder.vertex(0.2f, hullHeight, hullZFront);
+    builder.vertex(0.2f, hullHeight, hullZBack);
+    builder.vertex(-0.2f, hullHeight, hullZBack);
+    builder.end();
+
+    // Bottom Face (GL_QUADS)
+    builder.color(0.7f, 0.7f, 0.0f); // Darker yellow for bottom
+    builder.begin(GL_QUADS);
+    builder.normal(0.0f, -1.0f, 0.0f); // Normal pointing down in Y
+    builder.vertex(-0.2f, 0.0f, hullZBack);
+    builder.vertex(0.2f, 0.0f, hullZBack);
+    builder.vertex(0.2f, 0.0f, hullZFront);
+    builder.vertex(-0.2f, 0.0f, hullZFront);
+    builder.end();
+
+    // Front Face (GL_QUADS)
+    builder.color(1.0f, 1.0f, 0.0f); // Yellow
+    builder.begin(GL_QUADS);
+    builder.normal(0.0f, 0.0f, 1.0f); // Normal pointing out in Z
+    builder.vertex(-0.2f, 0.0f, hullZFront);
+    builder.vertex(0.2f, 0.0f, hullZFront);
+    builder.vertex(0.2f, hullHeight, hullZFront);
+    builder.vertex(-0.2f, hullHeight, hullZFront);
+    builder.end();
+
+    // Back Face (GL_QUADS)
+    builder.begin(GL_QUADS);
+    builder.normal(0.0f, 0.0f, -1.0f); // Normal pointing in negative Z
+    builder.vertex(-0.2f, hullHeight, hullZBack);
+    builder.vertex(0.2f, hullHeight, hullZBack);
+    builder.vertex(0.2f, 0.0f, hullZBack);
+    builder.vertex(-0.2f, 0.0f, hullZBack);
+    builder.end();
+
+    // Right Side Face (GL_QUADS)
+    builder.begin(GL_QUADS);
+    builder.normal(1.0f, 0.0f, 0.0f); // Normal pointing right in X
+    builder.vertex(0.2f, 0.0f, hullZFront);
+    builder.vertex(0.2f, 0.0f, hullZBack);
+    builder.vertex(0.2f, hullHeight, hullZBack);
+    builder.vertex(0.2f, hullHeight, hullZFront);
+    builder.end();
+
+    // Left Side Face (GL_QUADS)
+    builder.begin(GL_QUADS);
+    builder.normal(-1.0f, 0.0f, 0.0f); // Normal pointing left in X
+    builder.vertex(-0.2f, hullHeight, hullZFront);
+    builder.vertex(-0.2f, hullHeight, hullZBack);
+    builder.vertex(-0.2f, 0.0f, hullZBack);
+    builder.vertex(-0.2f, 0.0f, hullZFront);
+    builder.end();
+
+
+    // Red rudder/fin (3D)
+    float rudderZFront = 0.01f; // Thin rudder
+    float rudderZBack = -0.01f;
+    builder.color(1.0f, 0.0f, 0.0f);
+
+    // Front face of rudder
+    builder.begin(GL_TRIANGLES);
+    builder.normal(0.0f, 0.0f, 1.0f); // Front face normal
+    builder.vertex(-0.2f, 0.1f, rudderZFront);
+    builder.vertex(-0.25f, 0.15f, rudderZFront);
+    builder.vertex(-0.2f, 0.0f, rudderZFront);
+    builder.end();
+
+    // Back face of rudder
+    builder.begin(GL_TRIANGLES);
+    builder.normal(0.0f, 0.0f, -1.0f); // Back face normal
+    builder.vertex(-0.2f, 0.0f, rudderZBack);
+    builder.vertex(-0.25f, 0.15f, rudderZBack);
+    builder.vertex(-0.2f, 0.1f, rudderZBack);
+    builder.end();
+
+    // Side faces of rudder (using QUADS to connect front and back triangles)
+    builder.begin(GL_QUADS);
+    // Bottom edge face
+    builder.normal(0.0f, -1.0f, 0.0f); // Normal points down (approx)
+    builder.vertex(-0.2f, 0.0f, rudderZFront);
+    builder.vertex(-0.2f, 0.0f, rudderZBack);
+    builder.vertex(-0.25f, 0.15f, rudderZBack); // Connects to top point
+    builder.vertex(-0.25f, 0.15f, rudderZFront);
+    builder.end();
+
+    builder.begin(GL_QUADS);
+    // Slanted top-front edge face
+    builder.normal(0.707f, 0.707f, 0.0f); // Normal roughly points up-right
+    builder.vertex(-0.2f, 0.1f, rudderZFront);
+    builder.vertex(-0.2f, 0.1f, rudderZBack);
+    builder.vertex(-0.25f, 0.15f, rudderZBack);
+    builder.vertex(-0.25f, 0.15f, rudderZFront);
+    builder.end();
+
+    builder.begin(GL_QUADS);
+    // Vertical back-edge face
+    builder.normal(-1.0f, 0.0f, 0.0f); // Normal points left (approx)
+    builder.vertex(-0.2f, 0.0f, rudderZFront);
+    builder.vertex(-0.2f, 0.1f, rudderZFront);
+    builder.vertex(-0.2f, 0.1f, rudderZBack);
+    builder.vertex(-0.2f, 0.0f, rudderZBack);
+    builder.end();
+
+
+    // Gray sail/wing on top (3D)
+    float sailZFront = 0.01f; // Thin sail
+    float sailZBack = -0.01f;
+    builder.color(0.3f, 0.3f, 0.3f);
+
+    // Front face of sail
+    builder.begin(GL_TRIANGLES);
+    builder.normal(0.0f, 0.0f, 1.0f); // Front face normal
+    builder.vertex(-0.05f, 0.1f, sailZFront);
+    builder.vertex(0.05f, 0.1f, sailZFront);
+    builder.vertex(0.0f, 0.2f, sailZFront);
+    builder.end();
+
+    // Back face of sail
+    builder.begin(GL_TRIANGLES);
+    builder.normal(0.0f, 0.0f, -1.0f); // Back face normal
+    builder.vertex(0.0f, 0.2f, sailZBack);
+    builder.vertex(0.05f, 0.1f, sailZBack);
+    builder.vertex(-0.05f, 0.1f, sailZBack);
+    builder.end();
+
+    // Side faces of sail (using QUADS)
+    builder.begin(GL_QUADS);
+    // Left edge face
+    builder.normal(-0.5f, 0.5f, 0.0f); // Normal points left-up
+    builder.vertex(-0.05f, 0.1f, sailZFront);
+    builder.vertex(-0.05f, 0.1f, sailZBack);
+    builder.vertex(0.0f, 0.2f, sailZBack);
+    builder.vertex(0.0f, 0.2f, sailZFront);
+    builder.end();
+
+    builder.begin(GL_QUADS);
+    // Right edge face
+    builder.normal(0.5f, 0.5f, 0.0f); // Normal points right-up
+    builder.vertex(0.0f, 0.2f, sailZFront);
+    builder.vertex(0.0f, 0.2f, sailZBack);
+    builder.vertex(0.05f, 0.1f, sailZBack);
+    builder.vertex(0.05f, 0.1f, sailZFront);
+    builder.end();
+
+    builder.begin(GL_QUADS);
+    // Bottom edge face
+    builder.normal(0.0f, -1.0f, 0.0f); // Normal points down
+    builder.vertex(-0.05f, 0.1f, sailZFront);
+    builder.vertex(0.05f, 0.1f, sailZFront);
+    builder.vertex(0.05f, 0.1f, sailZBack);
+    builder.vertex(-0.05f, 0.1f, sailZBack);
+    builder.end();
+
+    return builder;
+}
+
+// The iceberg prism, unscaled; same geometry as drawIceberg()
+MeshBuilder icebergGeometry() {
+    MeshBuilder builder;
+    builder.color(0.7f, 0.9f, 1.0f); // Light blue/white color for iceberg
+
+    // Draw iceberg as a 3D prism (simple triangular pyramid)
+    // Base triangle on XY plane
+    builder.begin(GL_TRIANGLES);
+    builder.normal(0.0f, 0.0f, 1.0f); // Normal for the top face of the base (facing viewer)
+    builder.vertex(-0.1f, 0.0f, 0.05f); // Base-left point (front)
+    builder.vertex(0.1f, 0.0f, 0.05f);  // Base-right point (front)
+    builder.vertex(0.0f, 0.2f, 0.05f);  // Top point (front)
+    builder.end();
+
+    builder.begin(GL_TRIANGLES);
+    builder.normal(0.0f, 0.0f, -1.0f); // Normal for the back face of the base
+    builder.vertex(0.0f, 0.2f, -0.05f); // Top point (back)
+    builder.vertex(0.1f, 0.0f, -0.05f);  // Base-right point (back)
+    builder.vertex(-0.1f, 0.0f, -0.05f); // Base-left point (back)
+    builder.end();
+
+    // Side faces (connecting front and back triangles)
+    builder.begin(GL_QUADS);
+    builder.normal(-0.8f, 0.0f, 0.5f); // Normal for left slant face
+    builder.vertex(-0.1f, 0.0f, 0.05f);
+    builder.vertex(0.0f, 0.2f, 0.05f);
+    builder.vertex(0.0f, 0.2f, -0.05f);
+    builder.vertex(-0.1f, 0.0f, -0.05f);
+    builder.end();
+
+    builder.begin(GL_QUADS);
+    builder.normal(0.8f, 0.0f, 0.5f); // Normal for right slant face
+    builder.vertex(0.1f, 0.0f, 0.05f);
+    builder.vertex(0.1f, 0.0f, -0.05f);
+    builder.vertex(0.0f, 0.2f, -0.05f);
+    builder.vertex(0.0f, 0.2f, 0.05f);
+    builder.end();
+
+    builder.begin(GL_QUADS);
+    builder.normal(0.0f, -1.0f, 0.0f); // Normal for bottom face
+    builder.vertex(-0.1f, 0.0f, 0.05f);
+    builder.vertex(-0.1f, 0.0f, -0.05f);
+    builder.vertex(0.1f, 0.0f, -0.05f);
+    builder.vertex(0.1f, 0.0f, 0.05f);
+    builder.end();
+
+    return builder;
+}
+
+// The iceberg's crack lines; a separate mesh because they are unlit lines
+MeshBuilder icebergCrackGeometry() {
+    MeshBuilder builder;
+    builder.color(0.5f, 0.7f, 0.8f); // Slightly darker shade for cracks
+    builder.begin(GL_LINES);
+    builder.vertex(-0.05f, 0.05f, 0.06f); builder.vertex(0.0f, 0.1f, 0.06f);
+    builder.vertex(0.05f, 0.05f, 0.06f); builder.vertex(0.0f, 0.1f, 0.06f);
+    builder.vertex(0.0f, 0.05f, 0.06f); builder.vertex(0.0f, 0.0f, 0.06f);
+    builder.end();
+    return builder;
+}
+
+// Sky gradient quad, as in drawSky()
+MeshBuilder skyGeometry() {
+    MeshBuilder builder;
+    builder.begin(GL_QUADS);
+    builder.color(0.7f, 0.9f, 1.0f); // Lighter blue at the top
+    builder.vertex(-1.5f, 1.0f, -0.9f);
+    builder.vertex(1.5f, 1.0f, -0.9f);
+    builder.color(0.4f, 0.7f, 1.0f); // Darker blue towards the horizon
+    builder.vertex(1.5f, 0.1f, -0.9f);
+    builder.vertex(-1.5f, 0.1f, -0.9f);
+    builder.end();
+    return builder;
+}
+
+// Disc around the origin, as in drawCircle()
+void addDisc(MeshBuilder& builder, float r, int segments) {
+    builder.begin(GL_TRIANGLE_FAN);
+    builder.vertex(0.0f, 0.0f, 0.0f);
+    for (int i = 0; i <= segments; i++) {
+        float theta = 2.0f * 3.1415926f * float(i) / float(segments);
+        builder.vertex(r * cosf(theta), r * sinf(theta), 0.0f);
+    }
+    builder.end();
+}
+
+// Sun glow and core, as in drawSun(), around the sun's position
+MeshBuilder sunGeometry() {
+    MeshBuilder builder;
+    builder.color(1.0f, 0.7f, 0.0f); // Orange glow
+    addDisc(builder, 0.18f, 30);
+    builder.color(1.0f, 0.9f, 0.0f); // Yellow core
+    addDisc(builder, 0.15f, 30);
+    return builder;
+}
+
+// Sphere centred on (cx, cy, cz), tessellated like solidSphere()
+void addSphere(MeshBuilder& builder, float cx, float cy, float cz, float radius, int slices, int stacks) {
+    const float pi = 3.1415926f;
+    for (int i = 0; i < stacks; i++) {
+        float phi0 = pi * i / stacks;
+        float phi1 = pi * (i + 1) / stacks;
+        builder.begin(GL_QUAD_STRIP);
+        for (int j = 0; j <= slices; j++) {
+            float theta = 2.0f * pi * j / slices;
+            float n0[3] = { cosf(theta) * sinf(phi0), sinf(theta) * sinf(phi0), cosf(phi0) };
+            float n1[3] = { cosf(theta) * sinf(phi1), sinf(theta) * sinf(phi1), cosf(phi1) };
+            builder.normal(n1[0], n1[1], n1[2]);
+            builder.vertex(cx + n1[0] * radius, cy + n1[1] * radius, cz + n1[2] * radius);
+            builder.normal(n0[0], n0[1], n0[2]);
+            builder.vertex(cx + n0[0] * radius, cy + n0[1] * radius, cz + n0[2] * radius);
+        }
+        builder.end();
+    }
+}
+
+// Unit sphere for the cloud puffs at one level of detail, shared by every cloud
+MeshBuilder cloudSphereGeometry(int lod) {
+    MeshBuilder builder;
+    builder.color(1.0f, 1.0f, 1.0f); // White color for clouds
+    addSphere(builder, 0.0f, 0.0f, 0.0f, 1.0f, cloudLodSlices[lod], cloudLodStacks[lod]);
+    return builder;
+}
+
+// Square around a shape's puffs, relative to the cloud position: center and half size
+void cloudShapeBounds(const CloudShape& shape, float& centerX, float& centerY, float& halfSize) {
+    float minX = 1e9f, maxX = -1e9f, minY = 1e9f, maxY = -1e9f;
+    for (const CloudPuff& puff : shape.puffs) {
+        minX = std::min(minX, puff.x - puff.radius);
+        maxX = std::max(maxX, puff.x + puff.radius);
+        minY = std::min(minY, puff.y - puff.radius);
+        maxY = std::max(maxY, puff.y + puff.radius);
+    }
+    centerX = (minX + maxX) * 0.5f;
+    centerY = (minY + maxY) * 0.5f;
+    halfSize = std::max(maxX - minX, maxY - minY) * 0.5f;
+}
+
+// Render each shape once, lit at its hand-placed position, into a tile of the impostor atlas
+// (transparent around the cloud). Without framebuffer objects every cloud stays 3D.
+void bakeCloudImpostors() {
+    if (!glGenFramebuffers || !glFramebufferTexture2D || !glGenRenderbuffers || !glRenderbufferStorage || !glFramebufferRenderbuffer) return;
+    int shapes = (int)cloudShapes.size();
+    int atlasWidth = cloudImpostorTile * shapes;
+    glGenTextures(1, &cloudLayer.impostorAtlas);
+    glBindTexture(GL_TEXTURE_2D, cloudLayer.impostorAtlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasWidth, cloudImpostorTile, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLuint framebuffer = 0, depthBuffer = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, atlasWidth, cloudImpostorTile);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    GLint targetFramebuffer = 0, viewport[4];
+    GLfloat clearColor[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &targetFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cloudLayer.impostorAtlas, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        glViewport(0, 0, atlasWidth, cloudImpostorTile);
+        glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glLoadIdentity();
+        GLfloat lightPosition[] = { sunLightX, sunLightY, sunLightZ, 1.0f }; // Same eye space as the scene
+        glLightfv(GL_LIGHT0, GL_POSITION, lightPosition);
+        for (int shape = 0; shape < shapes; shape++) {
+            const CloudShape& cloud = cloudShapes[shape];
+            float centerX, centerY, halfSize;
+            cloudShapeBounds(cloud, centerX, centerY, halfSize);
+            glViewport(shape * cloudImpostorTile, 0, cloudImpostorTile, cloudImpostorTile);
+            glMatrixMode(GL_PROJECTION);
+            glLoadIdentity();
+            glOrtho(cloud.x + centerX - halfSize, cloud.x + centerX + halfSize, cloud.y + centerY - halfSize, cloud.y + centerY + halfSize, -1.0f, 1.0f);
+            glMatrixMode(GL_MODELVIEW);
+            for (const CloudPuff& puff : cloud.puffs) {
+                glPushMatrix();
+                glTranslatef(cloud.x + puff.x, cloud.y + puff.y, cloud.z + puff.z);
+                glScalef(puff.radius, puff.radius, puff.radius);
+                drawMesh(cloudLayer.spheres[0]);
+                glPopMatrix();
+            }
+        }
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    if (!complete) {
+        glDeleteTextures(1, &cloudLayer.impostorAtlas);
+        cloudLayer.impostorAtlas = 0;
+        return;
+    }
+    glGenBuffers(1, &cloudLayer.impostorBuffer);
+}
+
+// Pixels per world unit of the glOrtho view at the current window size
+float pixelsPerWorldUnit() {
+    return std::min(windowWidth / 3.0f, windowHeight / 2.0f);
+}
+
+// Choose, from on-screen size, which clouds are impostors and the LOD of every other puff.
+// The clouds don't move, so this only reruns when the window size changes.
+void classifyClouds() {
+    float pixels = pixelsPerWorldUnit();
+    if (pixels == cloudLayer.classifiedPixelsPerUnit) return;
+    cloudLayer.classifiedPixelsPerUnit = pixels;
+    cloudLayer.sphereDraws.clear();
+    cloudLayer.impostorClouds = 0;
+    std::vector<ImpostorVertex> quads;
+    float tileWidth = 1.0f / cloudShapes.size();
+    for (const Cloud& cloud : cloudLayer.clouds) {
+        const CloudShape& shape = cloudShapes[cloud.shape];
+        float centerX, centerY, halfSize;
+        cloudShapeBounds(shape, centerX, centerY, halfSize);
+        if (cloudLayer.useLod && cloudLayer.impostorAtlas && halfSize * cloud.scale * pixels < cloudImpostorPixels) {
+            float x = cloud.x + centerX * cloud.scale, y = cloud.y + centerY * cloud.scale, h = halfSize * cloud.scale;
+            float u0 = cloud.shape * tileWidth, u1 = u0 + tileWidth;
+            ImpostorVertex quad[4] = {
+                { { x - h, y - h, cloud.z }, { u0, 0.0f } },
+                { { x + h, y - h, cloud.z }, { u1, 0.0f } },
+                { { x + h, y + h, cloud.z }, { u1, 1.0f } },
+                { { x - h, y + h, cloud.z }, { u0, 1.0f } },
+            };
+            quads.insert(quads.end(), quad, quad + 4);
+            cloudLayer.impostorClouds++;
+            continue;
+        }
+        for (const CloudPuff& puff : shape.puffs) {
+            float radius = puff.radius * cloud.scale;
+            int lod = 0;
+            while (cloudLayer.useLod && lod < cloudLodCount - 1 && radius * pixels < cloudLodPixels[lod]) lod++;
+            cloudLayer.sphereDraws.push_back({ cloud.x + puff.x * cloud.scale, cloud.y + puff.y * cloud.scale, cloud.z + puff.z * cloud.scale, radius, lod });
+        }
+    }
+    cloudLayer.impostorVertices = (GLsizei)quads.size();
+    if (cloudLayer.impostorBuffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, cloudLayer.impostorBuffer);
+        glBufferData(GL_ARRAY_BUFFER, quads.size() * sizeof(ImpostorVertex), quads.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+// All impostors in one draw call: alpha-tested textured quads facing the (orthographic) camera
+void drawCloudImpostors() {
+    if (!cloudLayer.impostorVertices) return;
+    PROFILE_GPU_SCOPE("drawCloudImpostors");
+    glDisable(GL_LIGHTING); // Lighting is baked into the atlas
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.5f);
+    glBindTexture(GL_TEXTURE_2D, cloudLayer.impostorAtlas);
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBindBuffer(GL_ARRAY_BUFFER, cloudLayer.impostorBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(ImpostorVertex), (const void*)offsetof(ImpostorVertex, position));
+    glTexCoordPointer(2, GL_FLOAT, sizeof(ImpostorVertex), (const void*)offsetof(ImpostorVertex, texCoord));
+    glDrawArrays(GL_QUADS, 0, cloudLayer.impostorVertices);
+    countDraw(cloudLayer.impostorVertices);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glDisable(GL_ALPHA_TEST);
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_LIGHTING);
+}
+
+// Retained path: queue the 3D clouds' spheres at their LOD (or their baked meshes) and draw the impostors
+void drawCloudLayer() {
+    classifyClouds();
+    if (bakedLightingActive()) {
+        for (const Mesh& mesh : bakedLighting.clouds) submitMesh(PASS_BACKGROUND, mesh, false, -0.5f);
+    }
+    else {
+        for (const CloudSphereDraw& sphere : cloudLayer.sphereDraws) {
+            submitMesh(PASS_BACKGROUND, cloudLayer.spheres[sphere.lod], true, sphere.z, sphere.x, sphere.y, sphere.z, sphere.radius, sphere.radius, sphere.radius);
+        }
+    }
+    drawCloudImpostors();
+}
+
+// Water surface, as in drawWater()
+MeshBuilder waterGeometry() {
+    MeshBuilder builder;
+    builder.color(0.0f, 0.5f, 1.0f);
+    builder.normal(0.0f, 0.0f, 1.0f);
+    builder.begin(GL_QUADS);
+    builder.vertex(-1.5f, -1.0f, 0.0f);
+    builder.vertex(1.5f, -1.0f, 0.0f);
+    builder.vertex(1.5f, 0.1f, 0.0f);
+    builder.vertex(-1.5f, 0.1f, 0.0f);
+    builder.end();
+    return builder;
+}
+
+// Wave lines on the water, as in drawWater()
+MeshBuilder waveGeometry() {
+    MeshBuilder builder;
+    builder.color(0.8f, 0.9f, 1.0f);
+    builder.begin(GL_LINES);
+    builder.vertex(-1.4f, 0.08f, 0.01f); builder.vertex(-1.2f, 0.08f, 0.01f);
+    builder.vertex(-1.1f, 0.06f, 0.01f); builder.vertex(-0.9f, 0.06f, 0.01f);
+    builder.vertex(-0.6f, 0.09f, 0.01f); builder.vertex(-0.4f, 0.09f, 0.01f);
+    builder.vertex(-0.3f, 0.07f, 0.01f); builder.vertex(-0.1f, 0.07f, 0.01f);
+    builder.vertex(0.2f, 0.08f, 0.01f); builder.vertex(0.4f, 0.08f, 0.01f);
+    builder.vertex(0.5f, 0.06f, 0.01f); builder.vertex(0.7f, 0.06f, 0.01f);
+    builder.vertex(0.9f, 0.09f, 0.01f); builder.vertex(1.1f, 0.09f, 0.01f);
+    builder.end();
+    return builder;
+}
+
+// The retained meshes by the name they have in scene files, with their built-in geometry
+struct SceneMeshSlot {
+    const char* name;
+    Mesh* mesh;
+    GLenum primitive;
+    MeshBuilder (*geometry)();
+};
+const SceneMeshSlot sceneMeshSlots[] = {
+    { "boat", &boatMesh, GL_TRIANGLES, boatGeometry },
+    { "iceberg", &icebergMesh, GL_TRIANGLES, icebergGeometry },
+    { "iceberg_cracks", &icebergCrackMesh, GL_LINES, icebergCrackGeometry },
+    { "sky", &skyMesh, GL_TRIANGLES, skyGeometry },
+    { "sun", &sunMesh, GL_TRIANGLES, sunGeometry },
+    { "water", &waterMesh, GL_TRIANGLES, waterGeometry },
+    { "waves", &waveMesh, GL_LINES, waveGeometry },
+    { "cloud_sphere0", &cloudLayer.spheres[0], GL_TRIANGLES, [] { return cloudSphereGeometry(0); } },
+    { "cloud_sphere1", &cloudLayer.spheres[1], GL_TRIANGLES, [] { return cloudSphereGeometry(1); } },
+    { "cloud_sphere2", &cloudLayer.spheres[2], GL_TRIANGLES, [] { return cloudSphereGeometry(2); } },
+};
+static_assert(cloudLodCount == 3, "sceneMeshSlots lists one sphere per cloud LOD");
+
+// A mesh's geometry on the CPU: the scene file's copy when it has one, else the built-in one
+MeshBuilder sceneGeometry(const SceneMeshSlot& slot) {
+    const SceneMeshRecord* record = findSceneMesh(slot.name);
+    if (!record) return slot.geometry();
+    MeshBuilder builder;
+    const MeshVertex* vertices = scene.records<MeshVertex>(SCENE_VERTICES) + record->firstVertex;
+    const GLushort* indices = scene.records<GLushort>(SCENE_INDICES) + record->firstIndex;
+    builder.vertices.assign(vertices, vertices + record->vertexCount);
+    builder.indices.assign(indices, indices + record->indexCount);
+    return builder;
+}
+
+MeshBuilder sceneGeometry(const Mesh& mesh) {
+    for (const SceneMeshSlot& slot : sceneMeshSlots) {
+        if (slot.mesh == &mesh) return sceneGeometry(slot);
+    }
+    return MeshBuilder();
+}
+
+// --- Baked static lighting ---
+// The sun never moves and neither do the water, the clouds and the iceberg, so their lighting is
+// evaluated once on the CPU with the same model as GL_LIGHT0 and stored as vertex colors; they
+// are then drawn unlit. The boat and the fleet keep live lighting. updateBakedLighting() rebakes
+// when the light, the iceberg zoom or the clouds' LOD choice changes.
+
+// GL_LIGHT0 as init() sets it up: positional light without attenuation, color material for
+// ambient and diffuse, infinite viewer, each channel clamped. Position and normal are in eye
+// space; the normal is used as given, like fixed function without GL_NORMALIZE.
+void litVertexColor(const float position[3], const float normal[3], const float color[3], const float light[4], float out[3]) {
+    float toLight[3] = { light[0] - position[0], light[1] - position[1], light[2] - position[2] };
+    float length = std::sqrt(toLight[0] * toLight[0] + toLight[1] * toLight[1] + toLight[2] * toLight[2]);
+    for (float& component : toLight) component /= length;
+    float diffuse = std::max(0.0f, normal[0] * toLight[0] + normal[1] * toLight[1] + normal[2] * toLight[2]);
+    float specular = 0.0f;
+    if (diffuse > 0.0f) {
+        float halfVector[3] = { toLight[0], toLight[1], toLight[2] + 1.0f };
+        float halfLength = std::sqrt(halfVector[0] * halfVector[0] + halfVector[1] * halfVector[1] + halfVector[2] * halfVector[2]);
+        float facing = (normal[0] * halfVector[0] + normal[1] * halfVector[1] + normal[2] * halfVector[2]) / halfLength;
+        specular = std::pow(std::max(0.0f, facing), materialShininess);
+    }
+    for (int c = 0; c < 3; c++) {
+        float lit = color[c] * (sceneAmbient[c] + lightAmbient[c]) + color[c] * diffuse * lightDiffuse[c]
+            + specular * lightSpecular[c] * materialSpecular[c];
+        out[c] = std::min(1.0f, lit);
+    }
+}
+
+// Replace the builder's colors by their lit values
+void bakeBuilderLighting(MeshBuilder& builder, const float light[4]) {
+    for (MeshVertex& vertex : builder.vertices) {
+        float lit[3];
+        litVertexColor(vertex.position, vertex.normal, vertex.color, light, lit);
+        std::memcpy(vertex.color, lit, sizeof(lit));
+    }
+}
+
+void destroyMesh(Mesh& mesh) {
+    if (mesh.vertexArray) glDeleteVertexArrays(1, &mesh.vertexArray);
+    if (mesh.attributeArray) glDeleteVertexArrays(1, &mesh.attributeArray);
+    glDeleteBuffers(1, &mesh.vertexBuffer);
+    glDeleteBuffers(1, &mesh.indexBuffer);
+    mesh = Mesh();
+}
+
+// Water and the 3D clouds (the impostors already have their lighting baked into the atlas)
+void bakeScenery() {
+    PROFILE_SCOPE("bakeScenery");
+    BakedLighting& baked = bakedLighting;
+    const float* light = baked.lightPosition;
+    destroyMesh(baked.water);
+    MeshBuilder water = sceneGeometry(waterMesh);
+    bakeBuilderLighting(water, light);
+    baked.water = createMesh(water, GL_TRIANGLES);
+
+    // The spheres at their LOD in world space, as many per mesh as 16-bit indices allow. Front to
+    // back, like the render queue orders them, so the depth test rejects the hidden ones early.
+    for (Mesh& mesh : baked.clouds) destroyMesh(mesh);
+    baked.clouds.clear();
+    std::vector<CloudSphereDraw> spheres = cloudLayer.sphereDraws;
+    std::stable_sort(spheres.begin(), spheres.end(), [](const CloudSphereDraw& a, const CloudSphereDraw& b) { return a.z > b.z; });
+    MeshBuilder clouds;
+    clouds.color(1.0f, 1.0f, 1.0f); // White color for clouds
+    for (const CloudSphereDraw& sphere : spheres) {
+        size_t sphereVertices = (size_t)cloudLodStacks[sphere.lod] * (cloudLodSlices[sphere.lod] + 1) * 2;
+        if (clouds.vertices.size() + sphereVertices > 65536) {
+            bakeBuilderLighting(clouds, light);
+            baked.clouds.push_back(createMesh(clouds, GL_TRIANGLES));
+            clouds.vertices.clear();
+            clouds.indices.clear();
+        }
+        addSphere(clouds, sphere.x, sphere.y, sphere.z, sphere.radius, cloudLodSlices[sphere.lod], cloudLodStacks[sphere.lod]);
+    }
+    if (!clouds.vertices.empty()) {
+        bakeBuilderLighting(clouds, light);
+        baked.clouds.push_back(createMesh(clouds, GL_TRIANGLES));
+    }
+    baked.cloudPixelsPerUnit = cloudLayer.classifiedPixelsPerUnit;
+    baked.sceneryValid = true;
+    baked.bakes++;
+}
+
+// The iceberg at the current zoom, transformed the way glTranslatef/glScalef do it on the live
+// path (GL_RESCALE_NORMAL leaves an X/Y-only scale's normals as they are). The world light moves
+// whenever the camera does, so an existing mesh is rewritten in place instead of recreated.
+void bakeIceberg() {
+    PROFILE_SCOPE("bakeIceberg");
+    BakedLighting& baked = bakedLighting;
+    float zoom = drawnIcebergZoom();
+    MeshBuilder iceberg = sceneGeometry(icebergMesh);
+    for (MeshVertex& vertex : iceberg.vertices) {
+        vertex.position[0] = icebergX + vertex.position[0] * zoom;
+        vertex.position[1] = icebergY + vertex.position[1] * zoom;
+        vertex.normal[0] /= zoom;
+        vertex.normal[1] /= zoom;
+    }
+    bakeBuilderLighting(iceberg, baked.icebergLight);
+    if (baked.iceberg.vertexBuffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, baked.iceberg.vertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, iceberg.vertices.size() * sizeof(MeshVertex), iceberg.vertices.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    else baked.iceberg = createMesh(iceberg, GL_TRIANGLES);
+    baked.icebergZoom = zoom;
+    baked.icebergValid = true;
+    baked.bakes++;
+}
+
+// Called every frame after the lights are set; the first call is the startup bake
+void updateBakedLighting(const GLfloat lightPosition[4], const GLfloat worldLight[4]) {
+    if (!bakedLightingActive()) return;
+    BakedLighting& baked = bakedLighting;
+    if (std::memcmp(baked.lightPosition, lightPosition, sizeof(baked.lightPosition)) != 0) {
+        std::memcpy(baked.lightPosition, lightPosition, sizeof(baked.lightPosition));
+        baked.sceneryValid = false;
+    }
+    if (std::memcmp(baked.icebergLight, worldLight, sizeof(baked.icebergLight)) != 0) {
+        std::memcpy(baked.icebergLight, worldLight, sizeof(baked.icebergLight));
+        baked.icebergValid = false;
+    }
+    classifyClouds();
+    if (!baked.sceneryValid || baked.cloudPixelsPerUnit != cloudLayer.classifiedPixelsPerUnit) bakeScenery();
+    if (!baked.icebergValid || baked.icebergZoom != drawnIcebergZoom()) bakeIceberg();
+}
+
+// Build all retained-mode meshes; falls back to immediate mode if buffer objects are missing.
+// Meshes in the scene file are uploaded straight from the mapped file.
+void buildSceneMeshes() {
+    if (!loadGLFunctions()) {
+        std::cout << "Buffer objects not supported, using immediate mode." << std::endl;
+        useRetainedMeshes = false;
+        return;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (const SceneMeshSlot& slot : sceneMeshSlots) {
+        const SceneMeshRecord* record = findSceneMesh(slot.name);
+        if (!record) *slot.mesh = createMesh(slot.geometry(), slot.primitive);
+        else *slot.mesh = createMesh(scene.records<MeshVertex>(SCENE_VERTICES) + record->firstVertex, record->vertexCount,
+            scene.records<GLushort>(SCENE_INDICES) + record->firstIndex, record->indexCount, record->primitive);
+    }
+    scene.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Append a section of records to a scene file being written, 16-byte aligned
+template <typename T>
+void addSceneSection(std::vector<unsigned char>& bytes, std::vector<SceneSection>& sections, SceneSectionType type, const std::vector<T>& records) {
+    SceneSection section = { type, (std::uint32_t)records.size(), 0, records.size() * sizeof(T) };
+    bytes.resize((bytes.size() + 15) / 16 * 16);
+    section.offset = bytes.size();
+    bytes.insert(bytes.end(), (const unsigned char*)records.data(), (const unsigned char*)records.data() + section.bytes);
+    sections.push_back(section);
+}
+
+// --write-scene: store the current scene (built-in meshes, cloud shapes, story objects, the
+// clouds with --clouds and the fleet with --fleet/--world) as a scene file. Needs no GL context.
+bool writeScene(const std::string& path) {
+    std::vector<SceneMeshRecord> meshes;
+    std::vector<MeshVertex> vertices;
+    std::vector<GLushort> indices;
+    for (const SceneMeshSlot& slot : sceneMeshSlots) {
+        MeshBuilder geometry = sceneGeometry(slot);
+        SceneMeshRecord record = {};
+        std::strncpy(record.name, slot.name, sizeof(record.name) - 1);
+        record.primitive = slot.primitive;
+        record.firstVertex = (std::uint32_t)vertices.size();
+        record.vertexCount = (std::uint32_t)geometry.vertices.size();
+        record.firstIndex = (std::uint32_t)indices.size();
+        record.indexCount = (std::uint32_t)geometry.indices.size();
+        meshes.push_back(record);
+        vertices.insert(vertices.end(), geometry.vertices.begin(), geometry.vertices.end());
+        indices.insert(indices.end(), geometry.indices.begin(), geometry.indices.end());
+    }
+
+    std::vector<SceneCloudShape> shapes;
+    std::vector<CloudPuff> puffs;
+    for (const CloudShape& shape : cloudShapes) {
+        shapes.push_back({ shape.x, shape.y, shape.z, (std::uint32_t)puffs.size(), (std::uint32_t)shape.puffs.size() });
+        puffs.insert(puffs.end(), shape.puffs.begin(), shape.puffs.end());
+    }
+
+    std::vector<SceneObject> story(2, SceneObject());
+    story[0].x = boatStartX;
+    story[0].y = boatStartY;
+    story[0].scale = 1.0f;
+    story[1].x = icebergX;
+    story[1].y = icebergY;
+    story[1].scale = icebergZoomFactor;
+    std::vector<SceneObject> clouds;
+    for (const Cloud& cloud : cloudLayer.clouds) {
+        SceneObject record = {};
+        record.x = cloud.x;
+        record.y = cloud.y;
+        record.z = cloud.z;
+        record.scale = cloud.scale;
+        record.shape = (std::uint32_t)cloud.shape;
+        clouds.push_back(record);
+    }
+    std::vector<SceneObject> fleetBoats, icebergs;
+    for (int i = 0; i < fleetBoatCount; i++) {
+        int boat = 1 + i;
+        SceneObject record = {};
+        record.x = boats.x[boat];
+        record.y = boats.baseY[boat];
+        record.scale = boats.scale[boat];
+        std::memcpy(record.color, &boats.tint[boat * 3], sizeof(record.color));
+        record.speed = boats.speed[boat];
+        record.targetX = boats.targetX[boat];
+        fleetBoats.push_back(record);
+    }
+    for (const InstanceData& iceberg : fleetIcebergs) {
+        SceneObject record = {};
+        record.x = iceberg.offset[0];
+        record.y = iceberg.offset[1];
+        record.scale = iceberg.scale[1];
+        std::memcpy(record.color, iceberg.color, sizeof(record.color));
+        icebergs.push_back(record);
+    }
+
+    // The section table's size is known up front, so the data can follow it directly
+    const std::uint32_t sectionCount = 9;
+    std::vector<unsigned char> bytes(sizeof(SceneFileHeader) + sectionCount * sizeof(SceneSection));
+    std::vector<SceneSection> sections;
+    addSceneSection(bytes, sections, SCENE_MESHES, meshes);
+    addSceneSection(bytes, sections, SCENE_VERTICES, vertices);
+    addSceneSection(bytes, sections, SCENE_INDICES, indices);
+    addSceneSection(bytes, sections, SCENE_CLOUD_SHAPES, shapes);
+    addSceneSection(bytes, sections, SCENE_CLOUD_PUFFS, puffs);
+    addSceneSection(bytes, sections, SCENE_STORY, story);
+    addSceneSection(bytes, sections, SCENE_CLOUDS, clouds);
+    addSceneSection(bytes, sections, SCENE_FLEET_BOATS, fleetBoats);
+    addSceneSection(bytes, sections, SCENE_FLEET_ICEBERGS, icebergs);
+    SceneFileHeader header = { { 'B', 'S', 'C', 'N' }, 1, sectionCount, worldWidth };
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    std::memcpy(bytes.data() + sizeof(header), sections.data(), sections.size() * sizeof(SceneSection));
+
+    std::ofstream file(path, std::ios::binary);
+    file.write((const char*)bytes.data(), bytes.size());
+    if (!file) {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+    std::cout << "Wrote scene " << path << ": " << meshes.size() << " meshes, " << clouds.size() << " clouds, " << fleetBoats.size()
+        << " fleet boats, " << icebergs.size() << " fleet icebergs, " << bytes.size() << " bytes" << std::endl;
+    return true;
+}
+
+// --- Broadphase collision (sweep and prune on X) ---
+
+// Axis-aligned bounding box in the XY plane (all objects share the same thin Z range)
+struct Aabb {
+    float minX, maxX, minY, maxY;
+};
+
+// Unscaled bounds relative to each object's base position
+const Aabb boatLocalBounds = { -0.25f, 0.2f, 0.0f, 0.2f };   // Rudder tip to bow, keel to top of the sail
+const Aabb icebergLocalBounds = { -0.1f, 0.1f, 0.0f, 0.2f }; // Base of the prism to its peak
+
+// Pose an object's bounds were last computed from, so unchanged objects are not rebuilt
+struct ProxyPose {
+    float x = NAN, y = NAN, scale = NAN;
+    float fromX = NAN, fromY = NAN; // Boats: where this tick's move started
+};
+
+// Finds overlapping boat/iceberg pairs. Bounds are only recomputed when an object's pose
+// changes, and both lists are kept sorted by minX with an insertion sort, which is close to
+// linear because objects move only a little between ticks. Boats are then swept in minX
+// order against the icebergs that can still reach them, so the cost grows with
+// N log M + overlaps instead of N * M.
+struct Broadphase {
+    std::vector<Aabb> boatBounds;
+    std::vector<ProxyPose> boatPoses;
+    std::vector<unsigned char> boatActive; // Inactive boats (sinking, gone) never collide
+    std::vector<int> boatOrder;            // Boat indices sorted by minX
+
+    std::vector<Aabb> icebergBounds;
+    std::vector<ProxyPose> icebergPoses;
+    std::vector<int> icebergOrder;         // Iceberg indices sorted by minX
+    std::vector<float> icebergSortedMinX;  // minX in icebergOrder, for the binary search
+    float maxIcebergWidth = 0.0f;
+
+    bool boatsMoved = false;
+    bool icebergsMoved = false;
+    long long pairTests = 0;   // Narrow AABB tests performed, for statistics
+    long long proxyUpdates = 0; // Bounds rebuilt because an object moved or was rescaled
+
+    void resize(int boats, int icebergs) {
+        boatBounds.assign(boats, Aabb{ 0, 0, 0, 0 });
+        boatPoses.assign(boats, ProxyPose());
+        boatActive.assign(boats, 0);
+        boatOrder.resize(boats);
+        for (int i = 0; i < boats; i++) boatOrder[i] = i;
+        icebergBounds.assign(icebergs, Aabb{ 0, 0, 0, 0 });
+        icebergPoses.assign(icebergs, ProxyPose());
+        icebergOrder.resize(icebergs);
+        for (int i = 0; i < icebergs; i++) icebergOrder[i] = i;
+        boatsMoved = icebergsMoved = true;
+    }
+
+    static bool updatePose(ProxyPose& pose, float x, float y, float scale, Aabb& bounds, const Aabb& local) {
+        if (pose.x == x && pose.y == y && pose.scale == scale) return false;
+        pose.x = x; pose.y = y; pose.scale = scale;
+        bounds.minX = x + local.minX * scale;
+        bounds.maxX = x + local.maxX * scale;
+        bounds.minY = y + local.minY * scale;
+        bounds.maxY = y + local.maxY * scale;
+        return true;
+    }
+
+    // A boat's bounds cover its whole move from (fromX, fromY) to (x, y) this tick, so a boat
+    // that passes an iceberg between two ticks still produces the pair
+    void moveBoat(int boat, float fromX, float fromY, float x, float y, float scale, bool active) {
+        boatActive[boat] = active;
+        ProxyPose& pose = boatPoses[boat];
+        if (!active || (pose.fromX == fromX && pose.fromY == fromY && pose.x == x && pose.y == y && pose.scale == scale)) return;
+        pose.fromX = fromX; pose.fromY = fromY;
+        pose.x = x; pose.y = y; pose.scale = scale;
+        Aabb& bounds = boatBounds[boat];
+        bounds.minX = std::min(fromX, x) + boatLocalBounds.minX * scale;
+        bounds.maxX = std::max(fromX, x) + boatLocalBounds.maxX * scale;
+        bounds.minY = std::min(fromY, y) + boatLocalBounds.minY * scale;
+        bounds.maxY = std::max(fromY, y) + boatLocalBounds.maxY * scale;
+        boatsMoved = true;
+        proxyUpdates++;
+    }
+
+    void moveIceberg(int iceberg, float x, float y, float scale) {
+        if (updatePose(icebergPoses[iceberg], x, y, scale, icebergBounds[iceberg], icebergLocalBounds)) {
+            icebergsMoved = true;
+            proxyUpdates++;
+        }
+    }
+
+    // Restore minX order after small moves; near-linear when the list is almost sorted
+    static void insertionSort(std::vector<int>& order, const std::vector<Aabb>& bounds) {
+        for (size_t i = 1; i < order.size(); i++) {
+            int item = order[i];
+            float key = bounds[item].minX;
+            size_t j = i;
+            while (j > 0 && bounds[order[j - 1]].minX > key) {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = item;
+        }
+    }
+
+    // Sort from scratch, used the first time the lists are filled
+    static void fullSort(std::vector<int>& order, const std::vector<Aabb>& bounds) {
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return bounds[a].minX < bounds[b].minX; });
+    }
+
+    void sortIfMoved(bool firstSort) {
+        if (boatsMoved) {
+            if (firstSort) fullSort(boatOrder, boatBounds);
+            else insertionSort(boatOrder, boatBounds);
+            boatsMoved = false;
+        }
+        if (icebergsMoved) {
+            if (firstSort) fullSort(icebergOrder, icebergBounds);
+            else insertionSort(icebergOrder, icebergBounds);
+            icebergSortedMinX.resize(icebergOrder.size());
+            maxIcebergWidth = 0.0f;
+            for (size_t k = 0; k < icebergOrder.size(); k++) {
+                const Aabb& b = icebergBounds[icebergOrder[k]];
+                icebergSortedMinX[k] = b.minX;
+                maxIcebergWidth = std::max(maxIcebergWidth, b.maxX - b.minX);
+            }
+            icebergsMoved = false;
+        }
+    }
+
+    // Call onOverlap(boat, iceberg) for every active boat whose bounds overlap an iceberg
+    template <typename Callback>
+    void findPairs(Callback onOverlap, bool firstSort = false) {
+        sortIfMoved(firstSort);
+        size_t first = 0; // First iceberg that can still reach the current boat
+        for (int boat : boatOrder) {
+            if (!boatActive[boat]) continue;
+            const Aabb& a = boatBounds[boat];
+            // Icebergs starting before a.minX - maxIcebergWidth end before this boat and every later one
+            while (first < icebergOrder.size() && icebergSortedMinX[first] < a.minX - maxIcebergWidth) first++;
+            size_t last = std::upper_bound(icebergSortedMinX.begin() + first, icebergSortedMinX.end(), a.maxX) - icebergSortedMinX.begin();
+            for (size_t k = first; k < last; k++) {
+                int iceberg = icebergOrder[k];
+                const Aabb& b = icebergBounds[iceberg];
+                pairTests++;
+                bool xOverlap = (a.maxX >= b.minX && a.minX <= b.maxX);
+                bool yOverlap = (a.maxY >= b.minY && a.minY <= b.maxY);
+                if (xOverlap && yOverlap) onOverlap(boat, iceberg);
+            }
+        }
+    }
+};
+
+// --- Narrow phase (swept separating-axis test) ---
+// Broadphase pairs are confirmed against the actual outlines: the boat's hull, rudder and sail
+// and the iceberg's triangle, all convex and sharing the same thin Z range, so the test is 2D.
+// The boat moves in a straight line over the tick while the iceberg holds still; on every
+// separating axis (the edge normals of both outlines) the projected intervals overlap during a
+// range of the tick, and the pieces touch where all those ranges meet. The start of that range
+// is the time of impact, so a boat can't tunnel through an iceberg however long the tick, and
+// the empty corners of the bounding boxes beside the iceberg's slopes no longer count as hits.
+
+// Convex outline in the XY plane, unscaled and relative to the object's base position
+struct ConvexPiece {
+    int count;
+    float x[4], y[4];
+};
+
+// Same geometry as boatGeometry() and icebergGeometry()
+const ConvexPiece boatPieces[] = {
+    { 4, { -0.2f, 0.2f, 0.2f, -0.2f }, { 0.0f, 0.0f, 0.1f, 0.1f } }, // Hull
+    { 3, { -0.2f, -0.2f, -0.25f }, { 0.0f, 0.1f, 0.15f } },           // Rudder
+    { 3, { -0.05f, 0.05f, 0.0f }, { 0.1f, 0.1f, 0.2f } },             // Sail
+};
+const ConvexPiece icebergPiece = { 3, { -0.1f, 0.1f, 0.0f }, { 0.0f, 0.0f, 0.2f } };
+
+bool aabbCollision = false; // --aabb-collision: the old instantaneous bounding-box test
+
+// Narrow the contact range [enter, exit] to the part of the tick in which a and b overlap along
+// the normal of the edge from (x0, y0) to (x1, y1), a moving by (dx, dy). False when they stay apart.
+inline bool sweepAxis(const float* ax, const float* ay, int an, const float* bx, const float* by, int bn,
+    float x0, float y0, float x1, float y1, float dx, float dy, float& enter, float& exit) {
+    float nx = y0 - y1, ny = x1 - x0;
+    float aMin = INFINITY, aMax = -INFINITY, bMin = INFINITY, bMax = -INFINITY;
+    for (int i = 0; i < an; i++) {
+        float d = ax[i] * nx + ay[i] * ny;
+        aMin = std::min(aMin, d);
+        aMax = std::max(aMax, d);
+    }
+    for (int i = 0; i < bn; i++) {
+        float d = bx[i] * nx + by[i] * ny;
+        bMin = std::min(bMin, d);
+        bMax = std::max(bMax, d);
+    }
+    float speed = dx * nx + dy * ny;
+    if (std::fabs(speed) < 1e-12f) return aMax >= bMin && aMin <= bMax; // Not moving along this axis
+    float t0 = (bMin - aMax) / speed, t1 = (bMax - aMin) / speed;
+    if (t0 > t1) std::swap(t0, t1);
+    enter = std::max(enter, t0);
+    exit = std::min(exit, t1);
+    return enter <= exit;
+}
+
+// Fraction of the tick (0-1) at which convex polygon a, moving by (dx, dy), first touches the
+// static polygon b, or -1 if they don't touch during the tick; 0 if they already overlap
+float sweptContact(const float* ax, const float* ay, int an, const float* bx, const float* by, int bn, float dx, float dy) {
+    float enter = 0.0f, exit = 1.0f;
+    for (int i = 0, j = an - 1; i < an; j = i++) {
+        if (!sweepAxis(ax, ay, an, bx, by, bn, ax[j], ay[j], ax[i], ay[i], dx, dy, enter, exit)) return -1.0f;
+    }
+    for (int i = 0, j = bn - 1; i < bn; j = i++) {
+        if (!sweepAxis(ax, ay, an, bx, by, bn, bx[j], by[j], bx[i], by[i], dx, dy, enter, exit)) return -1.0f;
+    }
+    return enter;
+}
+
+// Time of impact of a boat moving from (fromX, fromY) to (toX, toY) this tick with an iceberg,
+// as a fraction of the tick, or -1 if no piece of the boat touches it
+float boatIcebergContact(float fromX, float fromY, float toX, float toY, float boatScale, float icebergPoseX, float icebergPoseY, float icebergScale) {
+    float bx[3], by[3];
+    for (int i = 0; i < icebergPiece.count; i++) {
+        bx[i] = icebergPoseX + icebergPiece.x[i] * icebergScale;
+        by[i] = icebergPoseY + icebergPiece.y[i] * icebergScale;
+    }
+    float first = -1.0f;
+    for (const ConvexPiece& piece : boatPieces) {
+        float ax[4], ay[4];
+        for (int i = 0; i < piece.count; i++) {
+            ax[i] = fromX + piece.x[i] * boatScale;
+            ay[i] = fromY + piece.y[i] * boatScale;
+        }
+        float t = sweptContact(ax, ay, piece.count, bx, by, icebergPiece.count, toX - fromX, toY - fromY);
+        if (t >= 0.0f && (first < 0.0f || t < first)) first = t;
+    }
+    return first;
+}
+
+// Boat and iceberg 0 are the story's boat and iceberg; fleet objects follow them
+Broadphase collisionWorld;
+bool collisionWorldSorted = false;
+
+// Move the boats' proxies, then sink every afloat boat that hits an iceberg (whose proxies are
+// already up to date) and pass it to onSink with the time of impact as a fraction of the tick.
+// The boat starts sinking from where it touched the first iceberg it reached. Shared by the
+// game and --batch.
+template <typename Callback>
+void sinkCollidingBoats(Broadphase& world, BoatStore& store, bool firstSort, Callback onSink) {
+    // Only boats that are afloat collide; poses that did not change keep their bounds
+    for (int boat = 0; boat < store.size(); boat++) {
+        bool afloat = store.has(boat, BOAT_VISIBLE);
+        if (aabbCollision) world.moveBoat(boat, store.x[boat], store.y[boat], store.x[boat], store.y[boat], store.scale[boat], afloat);
+        else world.moveBoat(boat, store.prevX[boat], store.prevY[boat], store.x[boat], store.y[boat], store.scale[boat], afloat);
+    }
+    // A boat's pairs arrive one after another, so its earliest contact is known once the next boat's start
+    int hitBoat = -1;
+    float hitTime = 0.0f;
+    auto sink = [&]() {
+        if (hitBoat < 0) return;
+        store.x[hitBoat] = store.prevX[hitBoat] + (store.x[hitBoat] - store.prevX[hitBoat]) * hitTime;
+        store.y[hitBoat] = store.prevY[hitBoat] + (store.y[hitBoat] - store.prevY[hitBoat]) * hitTime;
+        store.clear(hitBoat, BOAT_VISIBLE | BOAT_MOVING); // No longer an active entity; stop any ongoing movement
+        store.set(hitBoat, BOAT_SINKING);                  // Start sinking animation
+        onSink(hitBoat, hitTime);
+    };
+    world.findPairs([&](int boat, int iceberg) {
+        float t = 1.0f; // The old test: overlapping at the end of the tick
+        if (!aabbCollision) {
+            const ProxyPose& berg = world.icebergPoses[iceberg];
+            t = boatIcebergContact(store.prevX[boat], store.prevY[boat], store.x[boat], store.y[boat], store.scale[boat], berg.x, berg.y, berg.scale);
+            if (t < 0.0f) return; // The boxes overlap but the outlines don't touch
+        }
+        if (boat == hitBoat) {
+            hitTime = std::min(hitTime, t);
+            return;
+        }
+        sink();
+        hitBoat = boat;
+        hitTime = t;
+    }, firstSort);
+    sink();
+}
+
+// Check collision between all boats and icebergs
+void checkCollision() {
+    PROFILE_SCOPE("checkCollision");
+    if (collisionWorld.boatBounds.size() != (size_t)boats.size()) {
+        collisionWorld.resize(boats.size(), 1 + (int)fleetIcebergs.size());
+        collisionWorldSorted = false;
+    }
+
+    collisionWorld.moveIceberg(0, icebergX, icebergY, icebergZoomFactor);
+    for (size_t i = 0; i < fleetIcebergs.size(); i++) {
+        const InstanceData& iceberg = fleetIcebergs[i];
+        collisionWorld.moveIceberg(1 + (int)i, iceberg.offset[0], iceberg.offset[1], iceberg.scale[0]);
+    }
+
+    sinkCollidingBoats(collisionWorld, boats, !collisionWorldSorted, [](int boat, float) {
+        if (boat == storyBoat) std::cout << "Collision! Boat started sinking." << std::endl; // For debugging
+    });
+    collisionWorldSorted = true;
+}
+
+// Measure broadphase throughput against the naive all-pairs loop (--bench-broadphase).
+// "pairs/s" is the number of boat/iceberg pairs resolved per second, including the pairs the
+// sweep rejects without testing; "tests/s" counts AABB tests actually executed.
+void benchmarkBroadphase() {
+    using Clock = std::chrono::steady_clock;
+    const int objectCounts[] = { 1000, 10000, 100000 };
+    const int frames = 20;
+    std::printf("%8s %7s %8s | %12s %12s %10s %10s | %12s %10s | %8s\n", "objects", "boats", "icebergs",
+        "sap ms/frame", "tests/frame", "tests/s", "pairs/s", "naive ms/fr", "pairs/s", "overlaps");
+
+    for (int objects : objectCounts) {
+        int icebergs = objects / 10; // Harbour mix: one iceberg for every nine boats
+        int boats = objects - icebergs;
+        float stripWidth = objects * 0.01f; // Constant density, about the default scene's crowding
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> across(0.0f, stripWidth);
+        std::uniform_real_distribution<float> depth(-0.9f, 0.05f);
+        std::uniform_real_distribution<float> drift(-0.008f, 0.008f);
+        std::uniform_real_distribution<float> size(0.3f, 0.8f);
+
+        std::vector<float> boatX(boats), boatY(boats), speed(boats);
+        for (int i = 0; i < boats; i++) { boatX[i] = across(rng); boatY[i] = depth(rng); speed[i] = drift(rng); }
+
+        Broadphase broadphase;
+        broadphase.resize(boats, icebergs);
+        for (int i = 0; i < icebergs; i++) broadphase.moveIceberg(i, across(rng), depth(rng), size(rng));
+
+        long long overlaps = 0;
+        Clock::time_point start = Clock::now();
+        for (int frame = 0; frame < frames; frame++) {
+            for (int i = 0; i < boats; i++) {
+                float fromX = boatX[i];
+                boatX[i] += speed[i];
+                broadphase.moveBoat(i, fromX, boatY[i], boatX[i], boatY[i], 0.25f, true);
+            }
+            overlaps = 0; // Keep the last frame's count to cross-check against the naive loop
+            broadphase.findPairs([&](int, int) { overlaps++; }, frame == 0);
+        }
+        double sapSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+        double allPairs = (double)boats * icebergs;
+
+        // Naive O(N*M) loop over the same final bounds; fewer frames at 100k to keep the run short
+        int naiveFrames = objects >= 100000 ? 1 : 5;
+        long long naiveOverlaps = 0;
+        start = Clock::now();
+        for (int frame = 0; frame < naiveFrames; frame++) {
+            naiveOverlaps = 0;
+            for (int b = 0; b < boats; b++) {
+                const Aabb& a = broadphase.boatBounds[b];
+                for (int k = 0; k < icebergs; k++) {
+                    const Aabb& c = broadphase.icebergBounds[k];
+                    if (a.maxX >= c.minX && a.minX <= c.maxX && a.maxY >= c.minY && a.minY <= c.maxY) naiveOverlaps++;
+                }
+            }
+        }
+        double naiveSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::printf("%8d %7d %8d | %12.3f %12lld %10.3g %10.3g | %12.3f %10.3g | %8lld%s\n", objects, boats, icebergs,
+            sapSeconds * 1000.0 / frames, broadphase.pairTests / frames, broadphase.pairTests / sapSeconds, allPairs * frames / sapSeconds,
+            naiveSeconds * 1000.0 / naiveFrames, allPairs * naiveFrames / naiveSeconds,
+            overlaps, overlaps == naiveOverlaps ? "" : " (MISMATCH)");
+    }
+}
+
+// Compare the swept narrow phase with the old instantaneous AABB test (--bench-narrowphase).
+// Random boat moves past an iceberg at several tick rates go through both tests and a reference
+// that checks the outlines for overlap at 1024 points along each move. "missed" counts contacts
+// a test doesn't report and "false" hits without a contact; "toi err" is the mean distance
+// between the swept time of impact and the first sampled contact, as a fraction of the tick.
+void benchmarkNarrowphase() {
+    using Clock = std::chrono::steady_clock;
+    const int tickRates[] = { 60, 15, 5, 2 };
+    const int moves = 200000;
+    const int samples = 1024;
+    std::printf("%4s %8s | %8s %8s | %8s | %11s %10s | %12s %11s | %8s\n", "Hz", "max step", "aabb ns", "swept ns",
+        "contacts", "aabb missed", "aabb false", "swept missed", "swept false", "toi err");
+
+    for (int rate : tickRates) {
+        // Boats cruise at up to 3 units/s with a little bobbing, around an iceberg at the origin
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> speed(0.3f, 3.0f);
+        std::uniform_real_distribution<float> bob(-0.05f, 0.05f);
+        std::uniform_real_distribution<float> endX(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> endY(-0.3f, 0.5f);
+        std::uniform_real_distribution<float> boatSize(0.3f, 1.0f);
+        std::uniform_real_distribution<float> icebergSize(0.3f, 3.0f);
+        std::vector<float> fromX(moves), fromY(moves), toX(moves), toY(moves), boatScale(moves), icebergScale(moves);
+        for (int i = 0; i < moves; i++) {
+            toX[i] = endX(rng);
+            toY[i] = endY(rng);
+            fromX[i] = toX[i] - ((rng() & 1) ? 1.0f : -1.0f) * speed(rng) / rate;
+            fromY[i] = toY[i] - bob(rng) / rate;
+            boatScale[i] = boatSize(rng);
+            icebergScale[i] = icebergSize(rng);
+        }
+
+        std::vector<unsigned char> boxHit(moves);
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < moves; i++) {
+            const Aabb& a = boatLocalBounds;
+            const Aabb& b = icebergLocalBounds;
+            float s = boatScale[i], z = icebergScale[i];
+            boxHit[i] = toX[i] + a.maxX * s >= b.minX * z && toX[i] + a.minX * s <= b.maxX * z &&
+                toY[i] + a.maxY * s >= b.minY * z && toY[i] + a.minY * s <= b.maxY * z;
+        }
+        double boxSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<float> impact(moves);
+        start = Clock::now();
+        for (int i = 0; i < moves; i++) {
+            impact[i] = boatIcebergContact(fromX[i], fromY[i], toX[i], toY[i], boatScale[i], 0.0f, 0.0f, icebergScale[i]);
+        }
+        double sweptSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        long long contacts = 0, boxMissed = 0, boxFalse = 0, sweptMissed = 0, sweptFalse = 0;
+        double impactError = 0.0;
+        for (int i = 0; i < moves; i++) {
+            float first = -1.0f;
+            for (int k = 0; k <= samples && first < 0.0f; k++) {
+                float t = (float)k / samples;
+                float x = fromX[i] + (toX[i] - fromX[i]) * t, y = fromY[i] + (toY[i] - fromY[i]) * t;
+                if (boatIcebergContact(x, y, x, y, boatScale[i], 0.0f, 0.0f, icebergScale[i]) >= 0.0f) first = t;
+            }
+            bool touched = first >= 0.0f;
+            contacts += touched;
+            boxMissed += touched && !boxHit[i];
+            boxFalse += !touched && boxHit[i];
+            sweptMissed += touched && impact[i] < 0.0f;
+            sweptFalse += !touched && impact[i] >= 0.0f; // Grazing contacts between two samples land here
+            if (touched && impact[i] >= 0.0f) impactError += std::fabs(impact[i] - first);
+        }
+        long long bothHit = contacts - sweptMissed;
+        std::printf("%4d %8.3f | %8.1f %8.1f | %8lld | %11lld %10lld | %12lld %11lld | %8.5f\n", rate, 3.0f / rate,
+            boxSeconds * 1e9 / moves, sweptSeconds * 1e9 / moves, contacts, boxMissed, boxFalse, sweptMissed, sweptFalse,
+            bothHit > 0 ? impactError / bothHit : 0.0);
+    }
+}
+
+// --- Animated ocean (--ocean) ---
+// Replaces the flat water quad and its fixed wave lines with a grid displaced in the vertex
+// shader by a sum of directional sine waves. The water face is treated as a map of the sea seen
+// from above: x runs across, depth is the distance below the horizon line, and the wave height
+// lifts a point up the screen. Normals come from the analytic derivatives of the same sum. The
+// grid is uploaded once; per frame the CPU only sets the time uniform, whatever the resolution.
+// Boats sample the same function on the CPU so they ride the waves they are drawn on.
+
+const float oceanTop = horizonY; // Horizon line, where the old flat water ended
+const float oceanBottom = -1.05f; // Below the screen edge, so troughs never uncover it
+const float oceanLeft = -1.5f;
+const float oceanRight = 1.5f;
+const float oceanGravity = 2.0f; // Scaled to world units, so the long swell takes ~2 s per wave
+
+// One sine wave, in the layout the shader reads
+struct OceanWave {
+    float waveX, waveDepth; // Wave vector: travel direction times 2 pi / wavelength
+    float amplitude;
+    float frequency;        // Angular frequency, from deep-water dispersion: longer waves run faster
+};
+
+OceanWave makeOceanWave(float directionX, float directionDepth, float wavelength, float amplitude) {
+    float k = 2.0f * 3.14159265f / wavelength;
+    return { directionX * k, directionDepth * k, amplitude, std::sqrt(oceanGravity * k) };
+}
+
+// A long swell plus shorter chop from other directions (directions are unit length)
+const OceanWave oceanWaves[] = {
+    makeOceanWave(1.0f, 0.0f, 0.9f, 0.012f),
+    makeOceanWave(0.8f, 0.6f, 0.55f, 0.007f),
+    makeOceanWave(-0.6f, 0.8f, 0.33f, 0.004f),
+    makeOceanWave(0.96f, -0.28f, 0.21f, 0.0025f),
+};
+const int oceanWaveCount = (int)(sizeof(oceanWaves) / sizeof(oceanWaves[0]));
+
+struct Ocean {
+    int columns = 128;            // --ocean-grid <columns> <rows>
+    int rows = 32;
+    GLuint program = 0;           // 0 when unsupported
+    GLuint vertexBuffer = 0;      // (x, y) of the undisplaced grid
+    GLuint indexBuffer = 0;
+    GLsizei indexCount = 0;
+    GLint timeLocation = -1;
+};
+Ocean ocean;
+
+// Wave height over the point (x, y) of the flat water face at time t seconds.
+// Must match the sum in oceanVertexShader.
+float oceanHeight(float x, float y, float time) {
+    float depth = oceanTop - y;
+    float height = 0.0f;
+    for (const OceanWave& wave : oceanWaves) {
+        height += wave.amplitude * std::sin(wave.waveX * x + wave.waveDepth * depth - wave.frequency * time);
+    }
+    return height;
+}
+
+const char* oceanVertexShader = R"(
+uniform vec4 waves[WAVES]; // waveX, waveDepth, amplitude, frequency
+uniform float time;
+varying vec3 eyePosition;
+varying vec3 eyeNormal;
+varying float crest;       // Height relative to the highest possible wave
+
+void main() {
+    vec2 p = (gl_ModelViewMatrix * gl_Vertex).xy; // The modelview only places the grid under the camera
+    float depth = OCEAN_TOP - p.y;
+    float height = 0.0;
+    vec2 slope = vec2(0.0);  // d height / d(x, depth)
+    for (int i = 0; i < WAVES; i++) {
+        float phase = dot(waves[i].xy, vec2(p.x, depth)) - waves[i].w * time;
+        height += waves[i].z * sin(phase);
+        slope += waves[i].xy * (waves[i].z * cos(phase));
+    }
+    // Depth runs down the screen, so d/dy = -d/ddepth
+    vec3 normal = normalize(vec3(-slope.x, slope.y, 1.0));
+    vec4 eye = vec4(p.x, p.y + height, gl_Vertex.z, 1.0); // World space is eye space
+    eyePosition = eye.xyz;
+    eyeNormal = normal;
+    crest = height / MAX_HEIGHT;
+    gl_Position = gl_ProjectionMatrix * eye;
+}
+)";
+
+// GL_LIGHT0 and the front material, evaluated per pixel like the shader renderer
+const char* oceanFragmentShader = R"(
+varying vec3 eyePosition;
+varying vec3 eyeNormal;
+varying float crest;
+
+void main() {
+    vec3 water = mix(vec3(0.0, 0.5, 1.0), vec3(0.8, 0.9, 1.0), 0.6 * smoothstep(0.4, 1.0, crest)); // Lighter crests
+    vec3 n = normalize(eyeNormal);
+    vec3 toLight = normalize(gl_LightSource[0].position.xyz - eyePosition);
+    float diffuse = max(dot(n, toLight), 0.0);
+    float specular = 0.0;
+    if (diffuse > 0.0) {
+        specular = pow(max(dot(n, normalize(toLight + vec3(0.0, 0.0, 1.0))), 0.0), gl_FrontMaterial.shininess);
+    }
+    vec3 lit = water * (gl_LightModel.ambient.rgb + gl_LightSource[0].ambient.rgb)
+             + water * diffuse * gl_LightSource[0].diffuse.rgb
+             + specular * gl_LightSource[0].specular.rgb * gl_FrontMaterial.specular.rgb;
+    gl_FragColor = vec4(min(lit, 1.0), 1.0);
+}
+)";
+
+// Compile the ocean shader, upload the wave table and the grid. Without shaders or buffer
+// objects the ocean stays off and the flat water is drawn instead.
+void initOcean() {
+    if (!glCreateShader || !glGenBuffers || !glGetUniformLocation || !glUniform1f || !glUniform4f) {
+        if (oceanEnabled) std::cout << "Animated ocean not supported, drawing flat water." << std::endl;
+        oceanEnabled = false;
+        return;
+    }
+    float maxHeight = 0.0f;
+    for (const OceanWave& wave : oceanWaves) maxHeight += wave.amplitude;
+    std::string header = "#version 120\n#define WAVES " + std::to_string(oceanWaveCount)
+        + "\n#define OCEAN_TOP " + std::to_string(oceanTop) + "\n#define MAX_HEIGHT " + std::to_string(maxHeight) + "\n";
+    ocean.program = createProgram(oceanVertexShader, oceanFragmentShader, nullptr, header.c_str());
+    if (!ocean.program) {
+        if (oceanEnabled) std::cout << "Animated ocean unavailable, drawing flat water." << std::endl;
+        oceanEnabled = false;
+        return;
+    }
+    glUseProgram(ocean.program);
+    for (int i = 0; i < oceanWaveCount; i++) { // Constant for the whole run
+        std::string name = "waves[" + std::to_string(i) + "]";
+        const OceanWave& wave = oceanWaves[i];
+        glUniform4f(glGetUniformLocation(ocean.program, name.c_str()), wave.waveX, wave.waveDepth, wave.amplitude, wave.frequency);
+    }
+    ocean.timeLocation = glGetUniformLocation(ocean.program, "time");
+    glUseProgram(0);
+
+    // Grid of (columns + 1) x (rows + 1) points over the water face, two triangles per cell
+    int columns = ocean.columns, rows = ocean.rows;
+    std::vector<float> vertices;
+    vertices.reserve((size_t)(columns + 1) * (rows + 1) * 2);
+    for (int row = 0; row <= rows; row++) {
+        for (int column = 0; column <= columns; column++) {
+            vertices.push_back(oceanLeft + (oceanRight - oceanLeft) * column / columns);
+            vertices.push_back(oceanBottom + (oceanTop - oceanBottom) * row / rows);
+        }
+    }
+    std::vector<GLuint> indices;
+    indices.reserve((size_t)columns * rows * 6);
+    for (int row = 0; row < rows; row++) {
+        for (int column = 0; column < columns; column++) {
+            GLuint a = (GLuint)(row * (columns + 1) + column);
+            GLuint b = a + (GLuint)(columns + 1); // Same column, one row up
+            GLuint cell[6] = { a, a + 1, b + 1, a, b + 1, b };
+            indices.insert(indices.end(), cell, cell + 6);
+        }
+    }
+    glGenBuffers(1, &ocean.vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, ocean.vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &ocean.indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ocean.indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    ocean.indexCount = (GLsizei)indices.size();
+    if (oceanEnabled) std::cout << "Animated ocean: " << columns << "x" << rows << " grid, " << vertices.size() / 2 << " vertices" << std::endl;
+}
+
+// Simulation time being drawn: between the previous and the current tick, like the boats
+float oceanRenderTime() {
+    return std::max(0.0f, ((float)drawnTick() - 1.0f + renderAlpha) / simulationRate);
+}
+
+// Draw the water grid in one call; the only per-frame upload is the time. The grid is stretched
+// over the camera's view so its resolution on screen is the same at every zoom.
+void drawOcean() {
+    if (!drawnOceanEnabled()) return;
+    PROFILE_GPU_SCOPE("drawOcean");
+    glPushMatrix();
+    glTranslatef(camera.x, horizonY, 0.0f);
+    glScalef(1.0f / camera.zoom, 1.0f / camera.zoom, 1.0f);
+    glTranslatef(0.0f, -horizonY, 0.0f);
+    glUseProgram(ocean.program);
+    glUniform1f(ocean.timeLocation, oceanRenderTime());
+    glBindBuffer(GL_ARRAY_BUFFER, ocean.vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ocean.indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 0, nullptr);
+    glDrawElements(GL_TRIANGLES, ocean.indexCount, GL_UNSIGNED_INT, nullptr);
+    countDraw(ocean.indexCount);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glUseProgram(0);
+    glPopMatrix();
+}
+
+// Afloat boats ride the waves: their resting height plus the wave height under them at time t.
+// Sinking boats have left the surface and keep going down as before.
+void floatBoats(float time) {
+    if (!oceanEnabled) return;
+    workers.parallelFor(boats.size(), boatUpdateChunk, [time](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            if (boats.flags[i] & BOAT_VISIBLE) boats.y[i] = boats.baseY[i] + oceanHeight(boats.x[i], boats.baseY[i], time);
+        }
+    });
+}
+
+// Put afloat boats back at their resting height when the ocean is switched off
+void settleBoats() {
+    for (int i = 0; i < boats.size(); i++) {
+        if (boats.flags[i] & BOAT_VISIBLE) boats.y[i] = boats.baseY[i];
+    }
+}
+
+// --- Particles (splashes and wakes) ---
+// A fixed-capacity structure-of-arrays pool: a boat that starts sinking throws up a splash and
+// keeps foaming until it is under, and moving boats leave a wake. Particles are emitted and
+// integrated once per simulation tick from the drawn boat state, so they follow the snapshots
+// and headless runs stay deterministic. Dead particles are compacted away so the live ones are
+// contiguous, streamed to an orphaned buffer and drawn as point sprites in one call.
+struct ParticleVertex {
+    float position[3];
+    unsigned char color[4];
+};
+
+struct ParticlePool {
+    int capacity = 65536; // --particles; 0 turns the effects off
+    int count = 0;        // Live particles, always [0, count)
+    std::vector<float> x, y, vx, vy;
+    std::vector<float> ay;     // Gravity: spray falls back, wake foam floats
+    std::vector<float> floorY; // Spray dies when it falls back below the water it left
+    std::vector<float> life;   // Seconds left; <= 0 is dead
+    std::vector<float> fade;   // 1 / initial life, for the alpha
+    std::vector<std::uint32_t> color; // RGB, packed
+    std::vector<ParticleVertex> vertices; // Staging for the upload
+    std::vector<unsigned char> lastFlags; // Drawn boat flags at the last update, to spot new sinkings
+    std::uint32_t lastTick = 0;
+    std::uint64_t random = 0x2545F4914F6CDD1Dull;
+    GLuint buffer = 0, spriteTexture = 0;
+    long long emitted = 0, dropped = 0; // Dropped: emitted while the pool was full
+    double updateMs = 0.0;              // Emission, integration and compaction, summed over frames
+    double lastUpdateMs = 0.0;
+    long long updatedFrames = 0, liveSum = 0;
+    int peak = 0;
+
+    float uniform(float low, float high) {
+        std::uint64_t z = (random += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        return low + (high - low) * (float)((z >> 40) * (1.0 / 16777216.0));
+    }
+};
+ParticlePool particles;
+
+// Allocate the pool once; nothing is allocated per particle afterwards
+void initParticles() {
+    ParticlePool& pool = particles;
+    if (pool.capacity <= 0) return;
+    for (std::vector<float>* field : { &pool.x, &pool.y, &pool.vx, &pool.vy, &pool.ay, &pool.floorY, &pool.life, &pool.fade }) field->resize(pool.capacity);
+    pool.color.resize(pool.capacity);
+    pool.vertices.resize(pool.capacity);
+    glGenBuffers(1, &pool.buffer);
+
+    // Round sprite: opaque in the middle, fading out towards the edge
+    const int size = 32;
+    std::vector<unsigned char> texels(size * size * 4);
+    for (int j = 0; j < size; j++) {
+        for (int i = 0; i < size; i++) {
+            float dx = (i + 0.5f) / size * 2.0f - 1.0f, dy = (j + 0.5f) / size * 2.0f - 1.0f;
+            float alpha = std::max(0.0f, 1.0f - std::sqrt(dx * dx + dy * dy));
+            unsigned char* texel = &texels[(j * size + i) * 4];
+            texel[0] = texel[1] = texel[2] = 255;
+            texel[3] = (unsigned char)(255.0f * std::min(1.0f, alpha * 1.5f));
+        }
+    }
+    glGenTextures(1, &pool.spriteTexture);
+    glBindTexture(GL_TEXTURE_2D, pool.spriteTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, texels.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Add one particle; false (and counted) when the pool is full
+bool emitParticle(float x, float y, float vx, float vy, float ay, float floorY, float life, std::uint32_t rgb) {
+    ParticlePool& pool = particles;
+    if (pool.count == pool.capacity) {
+        pool.dropped++;
+        return false;
+    }
+    int i = pool.count++;
+    pool.x[i] = x;
+    pool.y[i] = y;
+    pool.vx[i] = vx;
+    pool.vy[i] = vy;
+    pool.ay[i] = ay;
+    pool.floorY[i] = floorY;
+    pool.life[i] = life;
+    pool.fade[i] = 1.0f / life;
+    pool.color[i] = rgb;
+    pool.emitted++;
+    return true;
+}
+
+// Integrate particles [0, count) by dt and kill the ones that expired or fell back into the
+// water. Branch-free like updateBoatKernel(), so it vectorizes.
+void integrateParticleKernel(float* __restrict x, float* __restrict y, float* __restrict vx, float* __restrict vy,
+    const float* __restrict ay, const float* __restrict floorY, float* __restrict life, int count, float dt) {
+    float drag = 1.0f - 1.5f * dt; // Air and water slow everything down
+    for (int i = 0; i < count; i++) {
+        vx[i] *= drag;
+        vy[i] = vy[i] * drag + ay[i] * dt;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        unsigned under = (unsigned)(y[i] < floorY[i]) & (unsigned)(vy[i] < 0.0f);
+        life[i] = selectFloat(under, 0.0f, life[i] - dt);
+    }
+}
+
+// Move the live particles to the front, keeping their order
+void compactParticles() {
+    ParticlePool& pool = particles;
+    int live = 0;
+    for (int i = 0; i < pool.count; i++) {
+        if (pool.life[i] <= 0.0f) continue;
+        if (live != i) {
+            pool.x[live] = pool.x[i];
+            pool.y[live] = pool.y[i];
+            pool.vx[live] = pool.vx[i];
+            pool.vy[live] = pool.vy[i];
+            pool.ay[live] = pool.ay[i];
+            pool.floorY[live] = pool.floorY[i];
+            pool.life[live] = pool.life[i];
+            pool.fade[live] = pool.fade[i];
+            pool.color[live] = pool.color[i];
+        }
+        live++;
+    }
+    pool.count = live;
+}
+
+const std::uint32_t splashColor = 0xF0F8FF; // Spray, almost white
+const std::uint32_t foamColor = 0xD8ECFF;   // Wake and bubbles, a little blue
+
+// One tick of emission from the drawn boats
+void emitBoatParticles(const BoatStore& drawn, float dt) {
+    ParticlePool& pool = particles;
+    if ((int)pool.lastFlags.size() != drawn.size()) pool.lastFlags.assign(drawn.flags.begin(), drawn.flags.end());
+    int movingBoats = 0;
+    for (int boat = 0; boat < drawn.size(); boat++) movingBoats += (drawn.flags[boat] & (BOAT_VISIBLE | BOAT_MOVING)) == (BOAT_VISIBLE | BOAT_MOVING);
+    // Thin the wakes of big fleets so they can't crowd the splashes out of the pool
+    const float wakeLife = 1.2f;
+    float wakeChance = movingBoats ? std::min(1.0f, 0.5f * pool.capacity / (movingBoats * wakeLife * simulationRate)) : 0.0f;
+    for (int boat = 0; boat < drawn.size(); boat++) {
+        unsigned char flags = drawn.flags[boat];
+        float x = drawn.x[boat], waterY = drawn.baseY[boat], scale = drawn.scale[boat];
+        if ((flags & BOAT_SINKING) && !(pool.lastFlags[boat] & BOAT_SINKING)) { // Just hit an iceberg
+            int count = (int)(60 * scale) + 4;
+            for (int i = 0; i < count; i++) {
+                emitParticle(x + pool.uniform(-0.2f, 0.2f) * scale, waterY + 0.05f * scale, pool.uniform(-0.5f, 0.5f) * scale,
+                    pool.uniform(0.4f, 1.1f) * std::sqrt(scale), -2.0f, waterY - 0.02f, pool.uniform(0.6f, 1.2f), splashColor);
+            }
+        }
+        if ((flags & BOAT_SINKING) && drawn.y[boat] > waterY - 0.3f * scale) { // Foaming while it goes under
+            for (int i = 0; i < 2; i++) {
+                emitParticle(x + pool.uniform(-0.2f, 0.2f) * scale, waterY, pool.uniform(-0.1f, 0.1f), pool.uniform(0.05f, 0.25f),
+                    -0.6f, waterY - 0.05f, pool.uniform(0.3f, 0.7f), foamColor);
+            }
+        }
+        float moved = x - drawn.prevX[boat];
+        if ((flags & (BOAT_VISIBLE | BOAT_MOVING)) == (BOAT_VISIBLE | BOAT_MOVING) && moved != 0.0f && pool.uniform(0.0f, 1.0f) < wakeChance) {
+            float stern = x - (moved > 0.0f ? 0.2f : -0.2f) * scale;
+            emitParticle(stern, waterY + pool.uniform(0.0f, 0.02f) * scale, -moved / dt * 0.3f + pool.uniform(-0.05f, 0.05f), pool.uniform(0.0f, 0.04f),
+                0.0f, waterY - 1.0f, wakeLife * pool.uniform(0.7f, 1.0f), foamColor);
+        }
+    }
+    pool.lastFlags.assign(drawn.flags.begin(), drawn.flags.end());
+}
+
+// Catch up with the simulation: one emission and integration step per tick since the last
+// frame (a few at most after a stall)
+void updateParticles() {
+    ParticlePool& pool = particles;
+    if (!pool.buffer) return;
+    std::uint32_t tick = drawnTick();
+    if (tick == pool.lastTick) return;
+    PROFILE_SCOPE("updateParticles");
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::uint32_t ticks = tick > pool.lastTick ? std::min<std::uint32_t>(tick - pool.lastTick, 4) : 1;
+    pool.lastTick = tick;
+    float dt = 1.0f / simulationRate;
+    for (std::uint32_t i = 0; i < ticks; i++) {
+        emitBoatParticles(drawnBoats(), dt);
+        integrateParticleKernel(pool.x.data(), pool.y.data(), pool.vx.data(), pool.vy.data(), pool.ay.data(), pool.floorY.data(),
+            pool.life.data(), pool.count, dt);
+        compactParticles();
+    }
+    pool.lastUpdateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    pool.updateMs += pool.lastUpdateMs;
+    pool.updatedFrames++;
+    pool.liveSum += pool.count;
+    pool.peak = std::max(pool.peak, pool.count);
+}
+
+// Stream the live particles and draw them as point sprites in one call
+void drawParticles() {
+    ParticlePool& pool = particles;
+    if (!pool.buffer || pool.count == 0) return;
+    PROFILE_GPU_SCOPE("drawParticles");
+    for (int i = 0; i < pool.count; i++) {
+        ParticleVertex& vertex = pool.vertices[i];
+        vertex.position[0] = pool.x[i];
+        vertex.position[1] = pool.y[i];
+        vertex.position[2] = 0.1f; // In front of the boats
+        vertex.color[0] = (unsigned char)(pool.color[i] >> 16);
+        vertex.color[1] = (unsigned char)(pool.color[i] >> 8);
+        vertex.color[2] = (unsigned char)pool.color[i];
+        vertex.color[3] = (unsigned char)(255.0f * std::min(1.0f, pool.life[i] * pool.fade[i] * 2.0f)); // Fade over the last half
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, pool.buffer);
+    // Orphan last frame's storage so the driver doesn't wait for the draw still reading it
+    glBufferData(GL_ARRAY_BUFFER, pool.count * sizeof(ParticleVertex), nullptr, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, pool.count * sizeof(ParticleVertex), pool.vertices.data());
+
+    glPushAttrib(GL_ENABLE_BIT | GL_POINT_BIT | GL_DEPTH_BUFFER_BIT | GL_TEXTURE_BIT);
+    if (useShaderRenderer) glUseProgram(0);
+    glDisable(GL_LIGHTING);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_FALSE); // Sprites overlap each other in any order
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, pool.spriteTexture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glEnable(GL_POINT_SPRITE);
+    glTexEnvi(GL_POINT_SPRITE, GL_COORD_REPLACE, GL_TRUE);
+    glPointSize(std::max(1.0f, std::min(24.0f, 0.03f * pixelsPerWorldUnit() * camera.zoom * sceneWidth / windowWidth)));
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(ParticleVertex), (const void*)offsetof(ParticleVertex, position));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(ParticleVertex), (const void*)offsetof(ParticleVertex, color));
+    glDrawArrays(GL_POINTS, 0, pool.count);
+    countDraw(pool.count);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+}
+
+// --- Background layer cache ---
+// Sky, sun, clouds and water never move, so they are rendered once into a color + depth texture
+// pair and composited each frame with one full-screen quad. The depth is written back too, so
+// the boat still sinks behind the water surface exactly as when the layer is drawn directly.
+
+bool useBackgroundCache = true; // Toggled with 'B', or started off with --no-bg-cache
+
+// Everything the cached image depends on; a mismatch with the current frame triggers a re-render
+struct BackgroundKey {
+    int width = 0, height = 0;
+    float lightPosition[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    bool flatWater = true; // Off while the animated ocean is drawn instead
+    bool bakedLighting = false;
+
+    bool operator==(const BackgroundKey& other) const {
+        return width == other.width && height == other.height && flatWater == other.flatWater && bakedLighting == other.bakedLighting
+            && std::memcmp(lightPosition, other.lightPosition, sizeof(lightPosition)) == 0;
+    }
+};
+
+struct BackgroundCache {
+    GLuint framebuffer = 0;
+    GLuint colorTexture = 0;
+    GLuint depthTexture = 0;
+    GLuint program = 0;      // Composite shader, 0 when unsupported (the cache is then bypassed)
+    bool valid = false;
+    BackgroundKey key;       // What the textures currently hold
+    int rebuilds = 0;
+};
+BackgroundCache backgroundCache;
+
+// Copies the cached color and depth; the vertices are already in clip space
+const char* backgroundVertexShader = R"(
+#version 120
+void main() {
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+    gl_Position = gl_Vertex;
+}
+)";
+
+const char* backgroundFragmentShader = R"(
+#version 120
+uniform sampler2D colorLayer;
+uniform sampler2D depthLayer;
+void main() {
+    gl_FragColor = texture2D(colorLayer, gl_TexCoord[0].st);
+    gl_FragDepth = texture2D(depthLayer, gl_TexCoord[0].st).r;
+}
+)";
+
+// Scene layer drawn into the cache (or directly when the cache is off)
+void drawBackground() {
+    if (useRetainedMeshes) { // Queued; drawn by the next executeRenderQueue()
+        submitMesh(PASS_BACKGROUND, skyMesh, false, -0.9f);
+        submitMesh(PASS_BACKGROUND, sunMesh, false, sunLightZ - 0.2f, sunLightX, sunLightY, sunLightZ - 0.2f);
+        drawCloudLayer(); // 3D clouds at their LOD, small ones as impostors
+        if (!drawnOceanEnabled()) {
+            if (bakedLightingActive()) submitMesh(PASS_BACKGROUND, bakedLighting.water, false, 0.0f);
+            else submitMesh(PASS_BACKGROUND, waterMesh, true, 0.0f);
+            submitMesh(PASS_BACKGROUND, waveMesh, false, 0.01f);
+        }
+        return;
+    }
+    drawSky();
+    drawSun(); // This draws the visual sun, the light position is set above
+    drawClouds(); // Now 3D
+    if (!drawnOceanEnabled()) drawWater(); // The animated ocean is drawn every frame by drawOcean()
+}
+
+// Mark the cached layer stale; it is re-rendered on the next frame that needs it
+void invalidateBackgroundCache() {
+    backgroundCache.valid = false;
+}
+
+// Create the composite shader; without shaders, framebuffer objects or multitexturing the
+// background is simply drawn every frame as before
+void initBackgroundCache() {
+    if (!glGenFramebuffers || !glFramebufferTexture2D || !glCreateShader || !glGetUniformLocation || !glUniform1i || !selectTextureUnit) return;
+    backgroundCache.program = createProgram(backgroundVertexShader, backgroundFragmentShader);
+    if (!backgroundCache.program) return;
+    glUseProgram(backgroundCache.program);
+    glUniform1i(glGetUniformLocation(backgroundCache.program, "colorLayer"), 0);
+    glUniform1i(glGetUniformLocation(backgroundCache.program, "depthLayer"), 1);
+    glUseProgram(0);
+}
+
+// (Re)allocate the textures at the current size and render the background into them
+bool rebuildBackgroundCache(const BackgroundKey& key) {
+    PROFILE_SCOPE("rebuildBackgroundCache");
+    BackgroundCache& cache = backgroundCache;
+    if (!cache.framebuffer) {
+        glGenFramebuffers(1, &cache.framebuffer);
+        glGenTextures(1, &cache.colorTexture);
+        glGenTextures(1, &cache.depthTexture);
+    }
+    if (key.width != cache.key.width || key.height != cache.key.height) {
+        glBindTexture(GL_TEXTURE_2D, cache.colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, key.width, key.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); // Drawn 1:1, no filtering
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, cache.depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, key.width, key.height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Render into the cache, then return to whatever framebuffer the frame targets
+    // (the window, or the offscreen framebuffer of a headless run)
+    GLint targetFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &targetFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, cache.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, cache.colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, cache.depthTexture, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    if (complete) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawBackground();
+        executeRenderQueue();
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+
+    cache.key = key;
+    cache.valid = complete;
+    cache.rebuilds++;
+    return complete;
+}
+
+// Draw the cached layer over the whole viewport, color and depth, in one quad
+void compositeBackground() {
+    PROFILE_GPU_SCOPE("compositeBackground");
+    glDisable(GL_LIGHTING);
+    glDepthFunc(GL_ALWAYS); // The layer replaces the cleared buffers outright
+    glUseProgram(backgroundCache.program);
+    selectTextureUnit(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, backgroundCache.depthTexture);
+    selectTextureUnit(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, backgroundCache.colorTexture);
+    glBegin(GL_QUADS);
+    glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+    glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, -1.0f);
+    glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+    glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f, 1.0f);
+    glEnd();
+    countDraw(4);
+    selectTextureUnit(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    selectTextureUnit(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_LIGHTING);
+}
+
+// Draw the static background, from the cache when possible
+void renderBackground(const GLfloat lightPosition[4]) {
+    if (!useBackgroundCache || !backgroundCache.program) {
+        drawBackground();
+        return;
+    }
+    BackgroundKey key;
+    key.width = sceneWidth;
+    key.height = sceneHeight;
+    key.flatWater = !drawnOceanEnabled();
+    key.bakedLighting = bakedLightingActive();
+    std::memcpy(key.lightPosition, lightPosition, sizeof(key.lightPosition));
+    if (!backgroundCache.valid || !(key == backgroundCache.key)) {
+        if (!rebuildBackgroundCache(key)) {
+            drawBackground();
+            return;
+        }
+    }
+    compositeBackground();
+}
+
+// Draw the whole scene into the current framebuffer
+void renderScene() {
+    PROFILE_SCOPE("renderScene");
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear color and depth buffers
+    glLoadIdentity();             // Reset the modelview matrix
+
+    // Set the light position (needs to be done in display before drawing objects)
+    GLfloat light_position[] = { sunLightX, sunLightY, sunLightZ, 1.0f }; // Positional light
+    applyBackdropProjection();
+    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+    updateFrameUniforms(light_position);
+
+    // World objects are lit from the point under the sun on screen, wherever the camera is
+    GLfloat worldLight[4];
+    backdropToWorld(light_position, worldLight);
+    updateBakedLighting(light_position, worldLight); // Rebakes the static meshes if a light or the zoom changed
+
+    // Draw scenery elements first (background to foreground based on Z)
+    renderBackground(light_position); // Sky, sun, clouds and water
+    executeRenderQueue(); // The backdrop the retained path queued, before the projection changes
+
+    applyCameraProjection();
+    glLightfv(GL_LIGHT0, GL_POSITION, worldLight);
+    updateFrameUniforms(worldLight);
+    drawOcean();   // Animated water (--ocean), drawn in place of the flat water
+    drawIceberg(); // Already 3D
+    drawBoat();    // Already 3D
+    executeRenderQueue(); // Everything the retained path queued above, sorted by state
+    drawFleet();   // Instanced boats and icebergs in view (fleet mode only)
+    updateParticles(); // Splashes and wakes, stepped by the ticks since the last frame
+    drawParticles();
+}
+
+// --- Dynamic resolution ---
+
+// (Re)allocate the offscreen target at the current scale; false if it can't be used
+bool resizeResolutionTarget() {
+    DynamicResolution& target = dynamicResolution;
+    int width = std::max(1, (int)std::lround(windowWidth * target.scale));
+    int height = std::max(1, (int)std::lround(windowHeight * target.scale));
+    if (target.framebuffer && width == target.width && height == target.height) return true;
+    if (!target.framebuffer) {
+        glGenFramebuffers(1, &target.framebuffer);
+        glGenTextures(1, &target.colorTexture);
+        glGenRenderbuffers(1, &target.depthBuffer);
     }
-    glEnd();
+    glBindTexture(GL_TEXTURE_2D, target.colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR); // Bilinear upscale
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    GLint presentFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &presentFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.colorTexture, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, target.depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target.depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, presentFramebuffer);
+    if (!complete) {
+        std::cout << "Dynamic resolution target unavailable; drawing at the window size." << std::endl;
+        target.budgetMs = 0.0;
+        return false;
+    }
+    target.width = width;
+    target.height = height;
+    return true;
 }
 
-// Draw the sky with a gradient
-void drawSky() {
-    // Disable lighting temporarily for background elements that shouldn't be lit
+// Stretch the target over the window with one bilinear-filtered quad
+void upscaleSceneTarget() {
+    PROFILE_GPU_SCOPE("upscale");
+    glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT);
     glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST); // Nothing else is drawn over the window
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, dynamicResolution.colorTexture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
     glBegin(GL_QUADS);
-    // Top (lighter blue)
-    glColor3f(0.7f, 0.9f, 1.0f); // Lighter blue at the top
-    glVertex3f(-1.5f, 1.0f, -0.9f); // Placed far back in Z
-    glVertex3f(1.5f, 1.0f, -0.9f);
-
-    // Bottom (slightly darker blue, above water horizon)
-    glColor3f(0.4f, 0.7f, 1.0f); // Darker blue towards the horizon
-    glVertex3f(1.5f, 0.1f, -0.9f);
-    glVertex3f(-1.5f, 0.1f, -0.9f);
+    glTexCoord2f(0.0f, 0.0f); glVertex2f(-1.0f, -1.0f);
+    glTexCoord2f(1.0f, 0.0f); glVertex2f(1.0f, -1.0f);
+    glTexCoord2f(1.0f, 1.0f); glVertex2f(1.0f, 1.0f);
+    glTexCoord2f(0.0f, 1.0f); glVertex2f(-1.0f, 1.0f);
     glEnd();
-    glEnable(GL_LIGHTING); // Re-enable lighting
+    countDraw(4);
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
 }
 
-// Draw the sun with a glow (visual representation only)
-void drawSun() {
-    glDisable(GL_LIGHTING); // Sun is a light source, but its visual representation doesn't need to be lit itself
-    glPushMatrix();
-    glTranslatef(sunLightX, sunLightY, sunLightZ - 0.2f); // Position of the sun visually, slightly behind light source actual Z
-    // Draw the glow
-    glColor3f(1.0f, 0.7f, 0.0f); // Orange glow
-    drawCircle(0.0f, 0.0f, 0.18f, 30);
+// Draw the scene, at the dynamic resolution when there is a frame budget
+void renderFrame() {
+    DynamicResolution& target = dynamicResolution;
+    if (target.budgetMs > 0.0) {
+        target.scaleSum += target.scale;
+        target.frames++;
+    }
+    // At full scale the upscale pass would only add a full-window fill
+    if (target.budgetMs <= 0.0 || target.scale >= 1.0f || !glGenFramebuffers || !resizeResolutionTarget()) {
+        sceneWidth = windowWidth;
+        sceneHeight = windowHeight;
+        renderScene();
+        return;
+    }
+    GLint presentFramebuffer = 0; // The window, or the offscreen framebuffer of a headless run
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &presentFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+    glViewport(0, 0, target.width, target.height);
+    sceneWidth = target.width;
+    sceneHeight = target.height;
+    renderScene();
+    glBindFramebuffer(GL_FRAMEBUFFER, presentFramebuffer);
+    glViewport(0, 0, windowWidth, windowHeight);
+    upscaleSceneTarget();
+}
 
-    // Draw the sun core
-    glColor3f(1.0f, 0.9f, 0.0f); // Yellow core
-    drawCircle(0.0f, 0.0f, 0.15f, 30);
-    glPopMatrix();
-    glEnable(GL_LIGHTING); // Re-enable lighting
+// Feed one frame's time to the controller. Over budget, the scale drops at once in proportion
+// (pixel count is roughly what software rasterization pays for); well under budget it rises
+// one step at a time, and every change restarts the sample window, so it can't oscillate.
+// The upscale pass is itself a full-window fill, so a scene that is cheap per pixel can end up
+// slower scaled than native; then it goes back to full scale and stays there for a while.
+void updateDynamicResolution(double frameMs) {
+    DynamicResolution& control = dynamicResolution;
+    if (control.budgetMs <= 0.0) return;
+    control.sampleSumMs += frameMs;
+    if (++control.samples < control.sampleFrames) return;
+    double average = control.sampleSumMs / control.samples;
+    control.lastAverageMs = average;
+    control.sampleSumMs = 0.0;
+    control.samples = 0;
+    float scale = control.scale;
+    if (scale >= 1.0f) control.nativeAverageMs = average;
+    if (control.hold > 0) control.hold--;
+    if (average > control.budgetMs) {
+        if (scale < 1.0f && average >= control.nativeAverageMs) { // Scaling costs more than it saves
+            scale = 1.0f;
+            control.hold = control.holdWindows;
+        }
+        else if (control.hold == 0) scale = std::floor(scale * (float)std::sqrt(control.budgetMs / average) / control.step) * control.step;
+    }
+    else if (average < control.budgetMs * control.raiseBelow) scale += control.step;
+    scale = std::min(1.0f, std::max(control.minScale, scale));
+    if (std::fabs(scale - control.scale) < control.step * 0.5f) return;
+    control.scale = scale;
+    control.changes++;
 }
 
-// Draw some fluffy clouds (NOW 3D)
-void drawClouds() {
-    glEnable(GL_LIGHTING); // Re-enable lighting for clouds as they are now 3D objects
-    glColor3f(1.0f, 1.0f, 1.0f); // White color for clouds
+// Windowed frames are timed without waiting for the GPU: a GL_TIMESTAMP query before and after
+// rendering (timestamps, unlike the profiler's GL_TIME_ELAPSED scopes, can be taken while one of
+// those is open), read a few frames later. The controller gets the larger of the GPU time and
+// the CPU time of the frame, whichever one bounds it. Without timer queries only the CPU side is
+// measured. Headless runs finish every frame anyway and time it directly.
+bool frameTimestampsSupported() {
+    return glGenQueries && glQueryCounter && glGetQueryObjectiv && glGetQueryObjectui64v;
+}
 
-    // Cloud 1
-    glPushMatrix();
-    glTranslatef(0.5f, 0.7f, -0.5f); // Z position for clouds
-    glutSolidSphere(0.12, 20, 20); // main sphere
-    glPushMatrix();
-    glTranslatef(0.08f, 0.05f, 0.03f); // Offset for another part of the cloud
-    glutSolidSphere(0.1, 20, 20);
-    glPopMatrix();
-    glPushMatrix();
-    glTranslatef(-0.07f, 0.03f, -0.02f); // Offset for another part
-    glutSolidSphere(0.09, 20, 20);
-    glPopMatrix();
-    glPushMatrix();
-    glTranslatef(0.02f, -0.05f, 0.05f); // Offset for another part
-    glutSolidSphere(0.1, 20, 20);
-    glPopMatrix();
-    glPopMatrix();
+// Feed every frame whose timestamps have arrived to the controller, oldest first
+void collectFrameTimings() {
+    DynamicResolution& control = dynamicResolution;
+    for (int k = 1; k <= control.timerSlots; k++) {
+        int slot = (control.nextTimer + k) % control.timerSlots;
+        if (!control.timerPending[slot]) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(control.timestamps[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return; // Later frames can't have finished either
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(control.timestamps[slot][0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(control.timestamps[slot][1], GL_QUERY_RESULT, &end);
+        control.timerPending[slot] = false;
+        updateDynamicResolution(std::max((end - begin) * 1e-6, control.submitMs[slot]));
+    }
+}
 
-    // Cloud 2
-    glPushMatrix();
-    glTranslatef(-0.3f, 0.85f, -0.6f); // Z position for clouds
-    glutSolidSphere(0.1, 20, 20);
-    glPushMatrix();
-    glTranslatef(-0.06f, -0.02f, 0.01f);
-    glutSolidSphere(0.08, 20, 20);
-    glPopMatrix();
-    glPushMatrix();
-    glTranslatef(0.05f, 0.03f, -0.03f);
-    glutSolidSphere(0.09, 20, 20);
-    glPopMatrix();
-    glPopMatrix();
+// Returns the timer slot this frame's rendering is timed with, or -1
+int beginFrameTiming() {
+    DynamicResolution& control = dynamicResolution;
+    if (control.budgetMs <= 0.0 || !frameTimestampsSupported()) return -1;
+    collectFrameTimings();
+    int slot = control.nextTimer;
+    if (control.timerPending[slot]) { // The GPU is more than timerSlots frames behind; don't wait for it
+        control.untimedFrames++;
+        return -1;
+    }
+    if (!control.timestamps[slot][0]) glGenQueries(2, control.timestamps[slot]);
+    glQueryCounter(control.timestamps[slot][0], GL_TIMESTAMP);
+    return slot;
+}
 
-    // Cloud 3
-    glPushMatrix();
-    glTranslatef(0.0f, 0.5f, -0.4f); // Z position for clouds
-    glutSolidSphere(0.07, 20, 20);
-    glPushMatrix();
-    glTranslatef(0.04f, 0.03f, 0.02f);
-    glutSolidSphere(0.06, 20, 20);
-    glPopMatrix();
-    glPushMatrix();
-    glTranslatef(-0.03f, -0.01f, -0.01f);
-    glutSolidSphere(0.05, 20, 20);
-    glPopMatrix();
-    glPopMatrix();
-    // No glDisable(GL_LIGHTING) at the end, as clouds are now lit 3D objects
+void endFrameTiming(int slot, double cpuMs) {
+    DynamicResolution& control = dynamicResolution;
+    if (control.budgetMs <= 0.0) return;
+    if (slot < 0) {
+        if (!frameTimestampsSupported()) updateDynamicResolution(cpuMs);
+        return;
+    }
+    glQueryCounter(control.timestamps[slot][1], GL_TIMESTAMP);
+    control.submitMs[slot] = cpuMs;
+    control.timerPending[slot] = true;
+    control.nextTimer = (slot + 1) % control.timerSlots;
 }
 
-// Draw the water layer with subtle waves
-void drawWater() {
-    glColor3f(0.0f, 0.5f, 1.0f); // Blue color for water (will be modulated by lighting)
-    glBegin(GL_QUADS);
-    glNormal3f(0.0f, 0.0f, 1.0f); // Normal pointing out of the screen (for flat surface)
-    glVertex3f(-1.5f, -1.0f, 0.0f); // Bottom-left corner of water
-    glVertex3f(1.5f, -1.0f, 0.0f);  // Bottom-right corner of water
-    glVertex3f(1.5f, 0.1f, 0.0f);   // Top-right corner of water
-    glVertex3f(-1.5f, 0.1f, 0.0f);  // Top-left corner of water
-    glEnd();
+// Printed by headless runs and when the window closes
+void printDynamicResolutionStats() {
+    const DynamicResolution& control = dynamicResolution;
+    if (control.budgetMs <= 0.0) return;
+    std::printf("dynamic resolution: %.1f ms budget, scale now %.2f (%dx%d), mean %.2f, %d changes, last average %.2f ms\n",
+        control.budgetMs, control.scale, sceneWidth, sceneHeight, control.frames ? control.scaleSum / control.frames : 1.0,
+        control.changes, control.lastAverageMs);
+    if (control.untimedFrames > 0) std::printf("dynamic resolution: %lld frames not timed, the GPU was %d frames behind\n", control.untimedFrames, control.timerSlots);
+}
 
-    // Draw subtle waves on top of the water (might look better without lighting or with specific material)
-    glDisable(GL_LIGHTING); // Temporarily disable lighting for wave lines
-    glColor3f(0.8f, 0.9f, 1.0f); // Light blue/white for waves
-    glBegin(GL_LINES);
-    // Line 1
-    glVertex3f(-1.4f, 0.08f, 0.01f); glVertex3f(-1.2f, 0.08f, 0.01f);
-    glVertex3f(-1.1f, 0.06f, 0.01f); glVertex3f(-0.9f, 0.06f, 0.01f);
-    // Line 2
-    glVertex3f(-0.6f, 0.09f, 0.01f); glVertex3f(-0.4f, 0.09f, 0.01f);
-    glVertex3f(-0.3f, 0.07f, 0.01f); glVertex3f(-0.1f, 0.07f, 0.01f);
-    // Line 3
-    glVertex3f(0.2f, 0.08f, 0.01f); glVertex3f(0.4f, 0.08f, 0.01f);
-    glVertex3f(0.5f, 0.06f, 0.01f); glVertex3f(0.7f, 0.06f, 0.01f);
-    // Line 4
-    glVertex3f(0.9f, 0.09f, 0.01f); glVertex3f(1.1f, 0.09f, 0.01f);
-    glEnd();
-    glEnable(GL_LIGHTING); // Re-enable lighting
+// --- Frame capture (--capture <file>) ---
+// Every drawn frame is read back into a ring of pixel buffer objects without waiting for it.
+// Two frames later the copy has long finished, so the buffer is mapped and the mapping handed
+// to the writer thread as is; the GL thread unmaps it once the writer is done. If the writer
+// still holds the buffer a new frame needs, that frame is dropped instead of waited for.
+enum CaptureSlotState { CAPTURE_FREE, CAPTURE_READING, CAPTURE_WRITING, CAPTURE_WRITTEN };
+
+struct CaptureSlot {
+    GLuint buffer = 0;
+    std::atomic<int> state{ CAPTURE_FREE };
+    const unsigned char* pixels = nullptr; // The mapping, while the writer has it
+};
+
+struct FrameCapture {
+    static const int slotCount = 4;
+    static const int latency = 2; // Frames between reading a frame back and mapping it
+    std::string path;
+    bool y4m = false;            // YUV4MPEG2 (4:2:0) instead of raw RGBA
+    int width = 0, height = 0;
+    CaptureSlot slots[slotCount];
+    long long frames = 0;        // Frames drawn while capturing
+    long long dropped = 0;       // Of those, frames not captured because the writer was behind
+    bool started = false;
+    FILE* file = nullptr;
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<int> queue;      // Slots handed to the writer, oldest frame first
+    bool stopping = false;
+    long long written = 0;                // Writer only until it has stopped
+    double writeMs = 0.0;                 // Writer only: time spent converting and writing
+    std::vector<unsigned char> converted; // Writer only: one frame in file layout
+};
+FrameCapture capture;
+
+// Convert one bottom-up RGBA frame to the file's layout and write it
+void writeCaptureFrame(const unsigned char* rgba) {
+    int width = capture.width, height = capture.height;
+    std::vector<unsigned char>& out = capture.converted;
+    if (!capture.y4m) { // Raw RGBA, top row first
+        out.resize((size_t)width * height * 4);
+        for (int y = 0; y < height; y++) std::memcpy(&out[(size_t)y * width * 4], rgba + (size_t)(height - 1 - y) * width * 4, (size_t)width * 4);
+    }
+    else { // BT.601 full-range ("C420jpeg"), chroma averaged over 2x2 pixels
+        int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+        out.resize((size_t)width * height + 2 * (size_t)chromaWidth * chromaHeight);
+        unsigned char* luma = out.data();
+        unsigned char* cb = luma + (size_t)width * height;
+        unsigned char* cr = cb + (size_t)chromaWidth * chromaHeight;
+        for (int y = 0; y < height; y++) {
+            const unsigned char* row = rgba + (size_t)(height - 1 - y) * width * 4;
+            for (int x = 0; x < width; x++) luma[(size_t)y * width + x] = (unsigned char)((77 * row[x * 4] + 150 * row[x * 4 + 1] + 29 * row[x * 4 + 2] + 128) >> 8);
+        }
+        for (int cy = 0; cy < chromaHeight; cy++) {
+            for (int cx = 0; cx < chromaWidth; cx++) {
+                int r = 0, g = 0, b = 0;
+                for (int i = 0; i < 4; i++) {
+                    int x = std::min(width - 1, cx * 2 + (i & 1)), y = std::min(height - 1, cy * 2 + (i >> 1));
+                    const unsigned char* pixel = rgba + ((size_t)(height - 1 - y) * width + x) * 4;
+                    r += pixel[0];
+                    g += pixel[1];
+                    b += pixel[2];
+                }
+                cb[(size_t)cy * chromaWidth + cx] = (unsigned char)std::min(255, std::max(0, ((-43 * r - 85 * g + 128 * b) / 4 + 32768 + 128) >> 8));
+                cr[(size_t)cy * chromaWidth + cx] = (unsigned char)std::min(255, std::max(0, ((128 * r - 107 * g - 21 * b) / 4 + 32768 + 128) >> 8));
+            }
+        }
+        std::fputs("FRAME\n", capture.file);
+    }
+    std::fwrite(out.data(), 1, out.size(), capture.file);
 }
 
+void captureWriterLoop() {
+    for (;;) {
+        int index;
+        {
+            std::unique_lock<std::mutex> lock(capture.mutex);
+            capture.wake.wait(lock, [] { return capture.stopping || !capture.queue.empty(); });
+            if (capture.queue.empty()) return; // Stopping, and everything handed over is written
+            index = capture.queue.front();
+            capture.queue.erase(capture.queue.begin());
+        }
+        CaptureSlot& slot = capture.slots[index];
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        writeCaptureFrame(slot.pixels);
+        capture.writeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        capture.written++;
+        slot.state.store(CAPTURE_WRITTEN, std::memory_order_release); // The GL thread unmaps it
+    }
+}
 
-// Draw the boat (3D)
-void drawBoat() {
-    if (!boatVisible && !isSinking && completelyGone) return;
-    if (!boatVisible && !isSinking) return; // Hide boat if not visible and not sinking
+// Allocate the buffers, open the file and start the writer at the current window size
+bool startCapture() {
+    capture.started = true;
+    if (!glMapBuffer || !glUnmapBuffer) {
+        std::cout << "Frame capture needs pixel buffer objects." << std::endl;
+        return false;
+    }
+    capture.width = windowWidth;
+    capture.height = windowHeight;
+    const std::string& path = capture.path;
+    capture.y4m = path.size() >= 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+    capture.file = std::fopen(path.c_str(), "wb");
+    if (!capture.file) {
+        std::cout << "Could not write " << path << std::endl;
+        return false;
+    }
+    if (capture.y4m) std::fprintf(capture.file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", capture.width, capture.height, headlessMode ? 60 : 1000 / std::max(1, frameIntervalMs));
+    for (CaptureSlot& slot : capture.slots) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)capture.width * capture.height * 4, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    capture.writer = std::thread(captureWriterLoop);
+    return true;
+}
 
-    glPushMatrix();
-    glTranslatef(boatX, boatY, 0.0f); // Translate boat to its current position
+// Unmap the buffers the writer has finished with
+void releaseCaptureSlots() {
+    for (CaptureSlot& slot : capture.slots) {
+        if (slot.state.load(std::memory_order_acquire) != CAPTURE_WRITTEN) continue;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        slot.pixels = nullptr;
+        slot.state = CAPTURE_FREE;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
 
-    // Define boat hull vertices for a box-like shape
-    // Front face (Z = 0.05)
-    // Back face (Z = -0.05)
-    // Length X: -0.2 to 0.2
-    // Height Y: 0.0 to 0.1 (relative to boatY)
-    float hullZFront = 0.05f;
-    float hullZBack = -0.05f;
-    float hullHeight = 0.1f;
+// Map a finished readback and queue it for the writer
+void handToWriter(int index) {
+    CaptureSlot& slot = capture.slots[index];
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    slot.pixels = (const unsigned char*)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (!slot.pixels) {
+        capture.dropped++;
+        slot.state = CAPTURE_FREE;
+        return;
+    }
+    slot.state = CAPTURE_WRITING;
+    {
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        capture.queue.push_back(index);
+    }
+    capture.wake.notify_one();
+}
 
-    // Boat hull (YELLOW)
-    glColor3f(1.0f, 1.0f, 0.0f); // Yellow color for the boat body
+// Write the remaining frames, stop the writer and report; called when the window closes or the
+// headless run ends, while the GL context still exists
+void finishCapture() {
+    if (!capture.writer.joinable()) return;
+    for (long long frame = std::max(0LL, capture.frames - capture.latency); frame < capture.frames; frame++) {
+        int index = (int)(frame % capture.slotCount);
+        if (capture.slots[index].state == CAPTURE_READING) handToWriter(index);
+    }
+    {
+        std::lock_guard<std::mutex> lock(capture.mutex);
+        capture.stopping = true;
+    }
+    capture.wake.notify_one();
+    capture.writer.join();
+    releaseCaptureSlots();
+    for (CaptureSlot& slot : capture.slots) glDeleteBuffers(1, &slot.buffer);
+    std::fclose(capture.file);
+    capture.file = nullptr;
+    std::printf("capture: %lld frames written to %s (%dx%d %s), %lld dropped because the writer fell behind; writer %.2f ms per frame\n",
+        capture.written, capture.path.c_str(), capture.width, capture.height, capture.y4m ? "Y4M 4:2:0" : "raw RGBA",
+        capture.dropped, capture.writeMs / std::max(1LL, capture.written));
+}
 
-    // Top Face (GL_QUADS)
-    glBegin(GL_QUADS);
-    glNormal3f(0.0f, 1.0f, 0.0f); // Normal pointing up in Y
-    glVertex3f(-0.2f, hullHeight, hullZFront);
-    glVertex3f(0.2f, hullHeight, hullZFront);
-    glVertex3f(0.2f, hullHeight, hullZBack);
-    glVertex3f(-0.2f, hullHeight, hullZBack);
-    glEnd();
+// Read back the frame just drawn, and pass the one read back two frames ago to the writer
+void captureFrame() {
+    if (capture.path.empty()) return;
+    PROFILE_SCOPE("captureFrame");
+    if (!capture.started && !startCapture()) capture.path.clear();
+    if (capture.path.empty()) return;
+    if (windowWidth != capture.width || windowHeight != capture.height) { // A file holds one frame size
+        std::cout << "Window resized: capture stopped." << std::endl;
+        finishCapture();
+        capture.path.clear();
+        return;
+    }
+    releaseCaptureSlots();
+    CaptureSlot& slot = capture.slots[capture.frames % capture.slotCount];
+    if (slot.state.load(std::memory_order_acquire) != CAPTURE_FREE) capture.dropped++; // Still with the writer
+    else {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+        glReadPixels(0, 0, capture.width, capture.height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr); // Queued; returns at once
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.state = CAPTURE_READING;
+    }
+    capture.frames++;
+    if (capture.frames > capture.latency) {
+        int ready = (int)((capture.frames - 1 - capture.latency) % capture.slotCount);
+        if (capture.slots[ready].state == CAPTURE_READING) handToWriter(ready);
+    }
+}
 
-    // Bottom Face (GL_QUADS)
-    glColor3f(0.7f, 0.7f, 0.0f); // Darker yellow for bottom
-    glBegin(GL_QUADS);
-    glNormal3f(0.0f, -1.0f, 0.0f); // Normal pointing down in Y
-    glVertex3f(-0.2f, 0.0f, hullZBack);
-    glVertex3f(0.2f, 0.0f, hullZBack);
-    glVertex3f(0.2f, 0.0f, hullZFront);
-    glVertex3f(-0.2f, 0.0f, hullZFront);
-    glEnd();
+// --- Input queue, recording and replay ---
+// GLUT callbacks only queue input; it is applied at the start of the next simulation tick, so
+// a session is fully described by (tick, event) pairs. --record writes them to a trace file and
+// --replay feeds a trace back in instead of live input, giving the same simulation every run.
 
-    // Front Face (GL_QUADS)
-    glColor3f(1.0f, 1.0f, 0.0f); // Yellow
-    glBegin(GL_QUADS);
-    glNormal3f(0.0f, 0.0f, 1.0f); // Normal pointing out in Z
-    glVertex3f(-0.2f, 0.0f, hullZFront);
-    glVertex3f(0.2f, 0.0f, hullZFront);
-    glVertex3f(0.2f, hullHeight, hullZFront);
-    glVertex3f(-0.2f, hullHeight, hullZFront);
-    glEnd();
+enum InputType : std::uint8_t { INPUT_KEY = 1, INPUT_CLICK = 2, INPUT_SPECIAL = 3 };
 
-    // Back Face (GL_QUADS)
-    glBegin(GL_QUADS);
-    glNormal3f(0.0f, 0.0f, -1.0f); // Normal pointing in negative Z
-    glVertex3f(-0.2f, hullHeight, hullZBack);
-    glVertex3f(0.2f, hullHeight, hullZBack);
-    glVertex3f(0.2f, 0.0f, hullZBack);
-    glVertex3f(-0.2f, 0.0f, hullZBack);
-    glEnd();
+// One input event as stored in a trace (12 bytes, native byte order)
+struct InputEvent {
+    std::uint32_t tick;    // Simulation tick the event is applied at
+    std::uint8_t type;     // InputType
+    std::uint8_t key;      // INPUT_KEY: the key; INPUT_SPECIAL: the GLUT_KEY_* code
+    std::uint16_t reserved;
+    float targetX;         // INPUT_CLICK: target in world units, so traces don't depend on the window size
+};
 
-    // Right Side Face (GL_QUADS)
-    glBegin(GL_QUADS);
-    glNormal3f(1.0f, 0.0f, 0.0f); // Normal pointing right in X
-    glVertex3f(0.2f, 0.0f, hullZFront);
-    glVertex3f(0.2f, 0.0f, hullZBack);
-    glVertex3f(0.2f, hullHeight, hullZBack);
-    glVertex3f(0.2f, hullHeight, hullZFront);
-    glEnd();
+// Trace file header
+struct InputTraceHeader {
+    char magic[4];              // "BTRC"
+    std::uint32_t version;      // 1
+    std::uint32_t simulationRate; // Ticks per second the trace was recorded at
+    std::uint32_t eventCount;
+    std::uint32_t endTick;      // Tick the recording stopped at
+};
 
-    // Left Side Face (GL_QUADS)
-    glBegin(GL_QUADS);
-    glNormal3f(-1.0f, 0.0f, 0.0f); // Normal pointing left in X
-    glVertex3f(-0.2f, hullHeight, hullZFront);
-    glVertex3f(-0.2f, hullHeight, hullZBack);
-    glVertex3f(-0.2f, 0.0f, hullZBack);
-    glVertex3f(-0.2f, 0.0f, hullZFront);
-    glEnd();
+// Live input on its way from the GLUT callbacks to the simulation: a single-producer,
+// single-consumer ring, so the GL thread never waits for the simulation thread
+struct QueuedInput {
+    InputEvent event;
+    std::chrono::steady_clock::time_point queued; // For the input-to-present latency
+};
 
+struct InputRing {
+    static const unsigned capacity = 256; // A power of two
+    QueuedInput events[capacity];
+    std::atomic<unsigned> head{ 0 }; // Next event to pop; consumer only
+    std::atomic<unsigned> tail{ 0 }; // Next free slot; producer only
+    long long dropped = 0;           // Producer only: events lost because the ring was full
 
-    // Red rudder/fin (3D)
-    float rudderZFront = 0.01f; // Thin rudder
-    float rudderZBack = -0.01f;
-    glColor3f(1.0f, 0.0f, 0.0f);
+    void push(const QueuedInput& input) {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == capacity) {
+            dropped++;
+            return;
+        }
+        events[t % capacity] = input;
+        tail.store(t + 1, std::memory_order_release);
+    }
+    bool pop(QueuedInput& input) {
+        unsigned h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        input = events[h % capacity];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
 
-    // Front face of rudder
-    glBegin(GL_TRIANGLES);
-    glNormal3f(0.0f, 0.0f, 1.0f); // Front face normal
-    glVertex3f(-0.2f, 0.1f, rudderZFront);
-    glVertex3f(-0.25f, 0.15f, rudderZFront);
-    glVertex3f(-0.2f, 0.0f, rudderZFront);
-    glEnd();
+InputRing liveInput;
+std::uint64_t inputsQueued = 0; // Producer side count, compared with the snapshots' inputsApplied
 
-    // Back face of rudder
-    glBegin(GL_TRIANGLES);
-    glNormal3f(0.0f, 0.0f, -1.0f); // Back face normal
-    glVertex3f(-0.2f, 0.0f, rudderZBack);
-    glVertex3f(-0.25f, 0.15f, rudderZBack);
-    glVertex3f(-0.2f, 0.1f, rudderZBack);
-    glEnd();
+std::vector<InputEvent> pendingInput; // A replayed trace, in tick order
+size_t nextPendingInput = 0;          // First event in pendingInput not applied yet
 
-    // Side faces of rudder (using QUADS to connect front and back triangles)
-    glBegin(GL_QUADS);
-    // Bottom edge face
-    glNormal3f(0.0f, -1.0f, 0.0f); // Normal points down (approx)
-    glVertex3f(-0.2f, 0.0f, rudderZFront);
-    glVertex3f(-0.2f, 0.0f, rudderZBack);
-    glVertex3f(-0.25f, 0.15f, rudderZBack); // Connects to top point
-    glVertex3f(-0.25f, 0.15f, rudderZFront);
-    glEnd();
+std::string inputRecordPath;         // --record <file>
+std::vector<InputEvent> recordedInput;
+std::string inputReplayPath;         // --replay <file>
+bool replayUnbounded = false;        // --replay-fast: one tick per frame, as fast as frames render
+std::uint32_t replayEndTick = 0;
+bool replayFinished = false;
+std::chrono::steady_clock::time_point replayStartTime;
 
-    glBegin(GL_QUADS);
-    // Slanted top-front edge face
-    glNormal3f(0.707f, 0.707f, 0.0f); // Normal roughly points up-right
-    glVertex3f(-0.2f, 0.1f, rudderZFront);
-    glVertex3f(-0.2f, 0.1f, rudderZBack);
-    glVertex3f(-0.25f, 0.15f, rudderZBack);
-    glVertex3f(-0.25f, 0.15f, rudderZFront);
-    glEnd();
+// Apply a render toggle key; false if the key is not one. These change nothing the simulation
+// reads, so with the simulation thread they are applied on the GL thread as they arrive.
+bool applyRenderKey(unsigned char key) {
+    if (key == 'm' || key == 'M') { // 'M' switches between retained meshes and immediate mode
+        if (boatMesh.vertexBuffer) {
+            useRetainedMeshes = !useRetainedMeshes;
+            std::cout << (useRetainedMeshes ? "Retained-mode meshes" : "Immediate mode") << std::endl;
+        }
+    }
+    else if (key == 'b' || key == 'B') { // 'B' switches the cached background layer on and off
+        if (backgroundCache.program) {
+            useBackgroundCache = !useBackgroundCache;
+            std::cout << (useBackgroundCache ? "Cached background layer" : "Background drawn every frame") << std::endl;
+        }
+    }
+    else if (key == 'l' || key == 'L') { // 'L' switches between baked and live lighting for the static meshes
+        bakedLighting.enabled = !bakedLighting.enabled;
+        std::cout << (bakedLighting.enabled ? "Baked static lighting" : "Live lighting") << std::endl;
+    }
+    else if (key == 'q' || key == 'Q') { // 'Q' switches the render queue between state-sorted and submission order
+        renderQueue.sorted = !renderQueue.sorted;
+        std::cout << (renderQueue.sorted ? "State-sorted render queue" : "Render queue in submission order") << std::endl;
+    }
+    else if (key == 'p' || key == 'P') { // 'P' shows and hides the profiler overlay
+        if (!profiler.enabled) enableProfiler();
+        profiler.overlay = !profiler.overlay;
+    }
+    else if ((key == 'i' || key == 'I') && fleetMode) { // 'I' switches fleet drawing between instanced and one-by-one
+        useInstancing = !useInstancing;
+        std::cout << (useInstancing ? "Instanced fleet" : "One draw call per fleet instance") << std::endl;
+    }
+    else return false;
+    return true;
+}
 
-    glBegin(GL_QUADS);
-    // Vertical back-edge face
-    glNormal3f(-1.0f, 0.0f, 0.0f); // Normal points left (approx)
-    glVertex3f(-0.2f, 0.0f, rudderZFront);
-    glVertex3f(-0.2f, 0.1f, rudderZFront);
-    glVertex3f(-0.2f, 0.1f, rudderZBack);
-    glVertex3f(-0.2f, 0.0f, rudderZBack);
-    glEnd();
+// Apply a key press: zooming the iceberg, boat movement, the ocean, resetting and render toggles
+void applyKey(unsigned char key) {
+    if (applyRenderKey(key)) return;
+    if (key == 's' || key == 'S') { // 'S' for zoom IN (makes iceberg bigger)
+        icebergZoomFactor += 0.1f;
+        if (icebergZoomFactor > 5.0f) icebergZoomFactor = 5.0f; // Cap max zoom
+    }
+    else if (key == 'w' || key == 'W') { // 'W' for zoom OUT (makes iceberg smaller)
+        icebergZoomFactor -= 0.1f;
+        if (icebergZoomFactor < 0.1f) icebergZoomFactor = 0.1f; // Don't allow negative or too small zoom
+    }
+    else if (key == 'o' || key == 'O') { // 'O' switches between the animated ocean and the flat water
+        if (ocean.program) {
+            oceanEnabled = !oceanEnabled;
+            if (!oceanEnabled) settleBoats();
+            std::cout << (oceanEnabled ? "Animated ocean" : "Flat water") << std::endl;
+        }
+    }
+    else if (key == 13) { // ASCII for Enter key
+        resetStoryBoat(); // Reset boat state
+        std::cout << "Story reset! Boat is back." << std::endl;
+    }
+    else if (key == 'd' || key == 'D') nudgeBoat(boats, storyBoat, keyboardBoatSpeed);  // Move boat forward (right)
+    else if (key == 'a' || key == 'A') nudgeBoat(boats, storyBoat, -keyboardBoatSpeed); // Move boat backward (left)
+}
 
+// Apply a mouse click: send the story boat towards targetX (in world units)
+void applyClick(float targetX) {
+    sendBoat(boats, storyBoat, targetX, boatMovementSpeed); // Ignored while the boat is sinking
+}
 
-    // Gray sail/wing on top (3D)
-    float sailZFront = 0.01f; // Thin sail
-    float sailZBack = -0.01f;
-    glColor3f(0.3f, 0.3f, 0.3f);
+// Apply a special key: the arrows scroll and zoom the camera, Home resets it
+void applySpecialKey(int key) {
+    ViewRect view = cameraView();
+    if (key == GLUT_KEY_LEFT) camera.x -= 0.1f * (view.right - view.left);
+    else if (key == GLUT_KEY_RIGHT) camera.x += 0.1f * (view.right - view.left);
+    else if (key == GLUT_KEY_UP) camera.zoom *= 1.25f;
+    else if (key == GLUT_KEY_DOWN) camera.zoom /= 1.25f;
+    else if (key == GLUT_KEY_HOME) camera = Camera();
+    clampCamera();
+}
 
-    // Front face of sail
-    glBegin(GL_TRIANGLES);
-    glNormal3f(0.0f, 0.0f, 1.0f); // Front face normal
-    glVertex3f(-0.05f, 0.1f, sailZFront);
-    glVertex3f(0.05f, 0.1f, sailZFront);
-    glVertex3f(0.0f, 0.2f, sailZFront);
-    glEnd();
+// Whether a replay still has ticks to run (keeps the frame scheduler awake)
+bool replayRunning() {
+    return !inputReplayPath.empty() && !replayFinished;
+}
 
-    // Back face of sail
-    glBegin(GL_TRIANGLES);
-    glNormal3f(0.0f, 0.0f, -1.0f); // Back face normal
-    glVertex3f(0.0f, 0.2f, sailZBack);
-    glVertex3f(0.05f, 0.1f, sailZBack);
-    glVertex3f(-0.05f, 0.1f, sailZBack);
-    glEnd();
+// Queue live input for the next tick; ignored while a trace is replaying
+void queueInput(InputType type, unsigned char key, float targetX) {
+    if (replayRunning()) return;
+    QueuedInput input = {};
+    input.event.type = type;
+    input.event.key = key;
+    input.event.targetX = targetX;
+    input.queued = std::chrono::steady_clock::now();
+    liveInput.push(input);
+    inputsQueued++;
+}
 
-    // Side faces of sail (using QUADS)
-    glBegin(GL_QUADS);
-    // Left edge face
-    glNormal3f(-0.5f, 0.5f, 0.0f); // Normal points left-up
-    glVertex3f(-0.05f, 0.1f, sailZFront);
-    glVertex3f(-0.05f, 0.1f, sailZBack);
-    glVertex3f(0.0f, 0.2f, sailZBack);
-    glVertex3f(0.0f, 0.2f, sailZFront);
-    glEnd();
+bool simulationThreadRunning();
 
-    glBegin(GL_QUADS);
-    // Right edge face
-    glNormal3f(0.5f, 0.5f, 0.0f); // Normal points right-up
-    glVertex3f(0.0f, 0.2f, sailZFront);
-    glVertex3f(0.0f, 0.2f, sailZBack);
-    glVertex3f(0.05f, 0.1f, sailZBack);
-    glVertex3f(0.05f, 0.1f, sailZFront);
-    glEnd();
+// Render toggles and the camera belong to the GL thread while the simulation has its own:
+// keyboard() and specialKey() apply them there, and they only pass through here to be recorded
+bool isRenderKey(unsigned char key) {
+    return key != 0 && std::strchr("mMbBlLqQpPiI", key) != nullptr; // The keys applyRenderKey() handles
+}
+bool appliedOnGlThread(const InputEvent& event) {
+    if (!simulationThreadRunning()) return false;
+    return event.type == INPUT_SPECIAL || (event.type == INPUT_KEY && isRenderKey(event.key));
+}
 
-    glBegin(GL_QUADS);
-    // Bottom edge face
-    glNormal3f(0.0f, -1.0f, 0.0f); // Normal points down
-    glVertex3f(-0.05f, 0.1f, sailZFront);
-    glVertex3f(0.05f, 0.1f, sailZFront);
-    glVertex3f(0.05f, 0.1f, sailZBack);
-    glVertex3f(-0.05f, 0.1f, sailZBack);
-    glEnd();
+void applyEvent(InputEvent event) {
+    event.tick = simulationTick;
+    if (appliedOnGlThread(event)) {} // Already done
+    else if (event.type == INPUT_KEY) applyKey(event.key);
+    else if (event.type == INPUT_CLICK) applyClick(event.targetX);
+    else if (event.type == INPUT_SPECIAL) applySpecialKey(event.key);
+    if (!inputRecordPath.empty()) recordedInput.push_back(event);
+}
 
+// Apply the live input queued since the last tick, or the replayed events due at this tick
+void applyInput() {
+    if (replayRunning() && simulationTick == 0) replayStartTime = std::chrono::steady_clock::now();
+    while (nextPendingInput < pendingInput.size() && pendingInput[nextPendingInput].tick <= simulationTick) {
+        applyEvent(pendingInput[nextPendingInput++]);
+    }
+    QueuedInput input;
+    while (liveInput.pop(input)) {
+        applyEvent(input.event);
+        inputsApplied++;
+        newestInputQueued = input.queued;
+    }
+}
 
-    glPopMatrix();
+// Called after every tick: report the replay's speed once its last tick has run
+void checkReplayFinished() {
+    if (!replayRunning() || simulationTick < replayEndTick) return;
+    replayFinished = true; // Live input is accepted again from here
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStartTime).count();
+    std::printf("Replay finished: %u ticks in %.3f s (%.0f ticks/s)\n", simulationTick, seconds, simulationTick / std::max(seconds, 1e-9));
 }
 
-// Draw iceberg (3D)
-void drawIceberg() {
-    glPushMatrix();
-    glTranslatef(icebergX, icebergY, 0.0f); // Translate iceberg to its base position
-    glScalef(icebergZoomFactor, icebergZoomFactor, 1.0f); // Apply zoom to the iceberg
+// Write the recorded session, if any; called on exit
+void saveInputTrace() {
+    if (inputRecordPath.empty()) return;
+    InputTraceHeader header = { { 'B', 'T', 'R', 'C' }, 1, (std::uint32_t)simulationRate, (std::uint32_t)recordedInput.size(), simulationTick };
+    std::ofstream file(inputRecordPath, std::ios::binary);
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)recordedInput.data(), recordedInput.size() * sizeof(InputEvent));
+    if (!file) std::cout << "Could not write " << inputRecordPath << std::endl;
+    else std::cout << "Recorded " << recordedInput.size() << " input events over " << simulationTick << " ticks to " << inputRecordPath << std::endl;
+    inputRecordPath.clear(); // Only once
+}
 
-    glColor3f(0.7f, 0.9f, 1.0f); // Light blue/white color for iceberg
+// Load a trace into the input queue; the simulation runs at the rate it was recorded at
+bool loadInputTrace(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    InputTraceHeader header;
+    if (!file.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, "BTRC", 4) != 0 || header.version != 1) {
+        std::cout << "Not an input trace: " << path << std::endl;
+        return false;
+    }
+    pendingInput.resize(header.eventCount);
+    if (!file.read((char*)pendingInput.data(), pendingInput.size() * sizeof(InputEvent))) {
+        std::cout << "Truncated input trace: " << path << std::endl;
+        return false;
+    }
+    if (simulationRate != (int)header.simulationRate) {
+        std::cout << "Replaying at the trace's " << header.simulationRate << " ticks per second" << std::endl;
+        simulationRate = (int)header.simulationRate;
+    }
+    replayEndTick = header.endTick;
+    std::cout << "Replaying " << header.eventCount << " input events over " << header.endTick << " ticks from " << path << std::endl;
+    return true;
+}
 
-    // Draw iceberg as a 3D prism (simple triangular pyramid)
-    // Base triangle on XY plane
-    glBegin(GL_TRIANGLES);
-    glNormal3f(0.0f, 0.0f, 1.0f); // Normal for the top face of the base (facing viewer)
-    glVertex3f(-0.1f, 0.0f, 0.05f); // Base-left point (front)
-    glVertex3f(0.1f, 0.0f, 0.05f);  // Base-right point (front)
-    glVertex3f(0.0f, 0.2f, 0.05f);  // Top point (front)
-    glEnd();
+// --- Simulation thread ---
+// By default the window runs the fixed-tick simulation on its own thread, paced by the clock
+// rather than by frames, so a slow or stalled frame no longer delays the ticks. After every
+// tick the thread publishes a snapshot through the triple buffer; the GL thread draws the
+// newest one, interpolating between its previous and current tick by the real time since it
+// was published. Input reaches the thread through the lock-free ring.
+bool simulationThreadRequested = true; // --single-thread turns it off; headless runs need --sim-thread
+int frameStallMs = 0;                  // --frame-stall: sleep this long every 30th frame
 
-    glBegin(GL_TRIANGLES);
-    glNormal3f(0.0f, 0.0f, -1.0f); // Normal for the back face of the base
-    glVertex3f(0.0f, 0.2f, -0.05f); // Top point (back)
-    glVertex3f(0.1f, 0.0f, -0.05f);  // Base-right point (back)
-    glVertex3f(-0.1f, 0.0f, -0.05f); // Base-left point (back)
-    glEnd();
+struct SimulationThread {
+    std::thread thread;
+    std::atomic<bool> owned{ false };   // Set before the thread starts and cleared once it has joined, so both threads can read it
+    std::atomic<bool> stopping{ false };
+    std::vector<double> tickIntervalMs; // Real time between ticks; read only once the thread has stopped
 
-    // Side faces (connecting front and back triangles)
-    glBegin(GL_QUADS);
-    glNormal3f(-0.8f, 0.0f, 0.5f); // Normal for left slant face
-    glVertex3f(-0.1f, 0.0f, 0.05f);
-    glVertex3f(0.0f, 0.2f, 0.05f);
-    glVertex3f(0.0f, 0.2f, -0.05f);
-    glVertex3f(-0.1f, 0.0f, -0.05f);
-    glEnd();
+    ~SimulationThread() { stop(); }
+    void stop() {
+        if (!thread.joinable()) return;
+        stopping = true;
+        thread.join();
+        owned = false;
+    }
+};
+SimulationThread simulationThread;
 
-    glBegin(GL_QUADS);
-    glNormal3f(0.8f, 0.0f, 0.5f); // Normal for right slant face
-    glVertex3f(0.1f, 0.0f, 0.05f);
-    glVertex3f(0.1f, 0.0f, -0.05f);
-    glVertex3f(0.0f, 0.2f, -0.05f);
-    glVertex3f(0.0f, 0.2f, 0.05f);
-    glEnd();
+bool simulationThreadRunning() { return simulationThread.owned.load(std::memory_order_acquire); }
 
-    glBegin(GL_QUADS);
-    glNormal3f(0.0f, -1.0f, 0.0f); // Normal for bottom face
-    glVertex3f(-0.1f, 0.0f, 0.05f);
-    glVertex3f(-0.1f, 0.0f, -0.05f);
-    glVertex3f(0.1f, 0.0f, -0.05f);
-    glVertex3f(0.1f, 0.0f, 0.05f);
-    glEnd();
+void simulationStep(float dt);
 
+void simulationThreadLoop() {
+    using Clock = std::chrono::steady_clock;
+    const double dt = 1.0 / simulationRate;
+    const Clock::duration tick = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(dt));
+    const Clock::duration maxBehind = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(maxFrameDelta));
+    Clock::time_point next = Clock::now() + tick, last = Clock::now();
+    while (!simulationThread.stopping.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_until(next);
+        Clock::time_point now = Clock::now();
+        if (now - next > maxBehind) next = now; // Suspended: drop the backlog rather than fast-forwarding
+        simulationStep((float)dt);
+        captureSnapshot(snapshots.writeSlot());
+        snapshots.publish();
+        simulationThread.tickIntervalMs.push_back(std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+        next += tick;
+    }
+}
 
-    // Add some cracks/details to the iceberg for more realism
-    glDisable(GL_LIGHTING); // Lines don't interact with lighting in the same way
-    glColor3f(0.5f, 0.7f, 0.8f); // Slightly darker shade for cracks
-    glBegin(GL_LINES);
-    glVertex3f(-0.05f, 0.05f, 0.06f); glVertex3f(0.0f, 0.1f, 0.06f);
-    glVertex3f(0.05f, 0.05f, 0.06f); glVertex3f(0.0f, 0.1f, 0.06f);
-    glVertex3f(0.0f, 0.05f, 0.06f); glVertex3f(0.0f, 0.0f, 0.06f);
-    glEnd();
-    glEnable(GL_LIGHTING);
+// Publish the current state as the first snapshot and start ticking
+void startSimulationThread() {
+    captureSnapshot(snapshots.writeSlot());
+    snapshots.publish();
+    shownSnapshot = &snapshots.latest();
+    simulationThread.owned.store(true, std::memory_order_release);
+    simulationThread.thread = std::thread(simulationThreadLoop);
+}
 
-    glPopMatrix();
+// Pick up the newest snapshot for this frame and how far real time has moved past its tick
+void acquireSnapshot() {
+    shownSnapshot = &snapshots.latest();
+    double sinceTick = std::chrono::duration<double>(std::chrono::steady_clock::now() - shownSnapshot->published).count();
+    renderAlpha = (float)std::min(1.0, sinceTick * simulationRate);
 }
 
-// Check collision between boat and iceberg
-void checkCollision() {
-    // Only check collision if boat is visible and not already sinking
-    if (!boatVisible || isSinking) return;
+// Input-to-present latency: from queueing an event to the first presented frame whose
+// snapshot has applied it
+struct PresentLatency {
+    std::uint64_t inputsPresented = 0;
+    std::vector<double> ms;
+};
+PresentLatency presentLatency;
 
-    // Boat's approximate 2D bounding box (from -0.25 to 0.2 in X, 0.0 to 0.2 in Y relative to boatX)
-    float boatMinX = boatX - 0.25f;
-    float boatMaxX = boatX + 0.2f;
-    float boatMinY = boatY + 0.0f; // Base of the boat body
-    float boatMaxY = boatY + 0.2f; // Top of the sail
+// Called after the frame has been handed to the display
+void recordPresentLatency() {
+    if (!shownSnapshot || shownSnapshot->inputsApplied <= presentLatency.inputsPresented) return;
+    presentLatency.inputsPresented = shownSnapshot->inputsApplied;
+    presentLatency.ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shownSnapshot->newestInputQueued).count());
+}
 
-    // Iceberg's approximate 2D bounding box, considering its scale
-    float icebergHalfWidth = 0.1f * icebergZoomFactor;
-    float icebergHeight = 0.2f * icebergZoomFactor;
+// --- Frame scheduler ---
+// The timer only keeps running while something is animating; once the scene is quiescent it
+// stops, and the next input wakes it up again. Input arriving while a frame is already
+// scheduled is coalesced into that frame.
+struct FrameScheduler {
+    bool alwaysRedraw = false; // --always-redraw: the old unconditional redraw every frame interval
+    bool timerArmed = false;   // A timer() call is pending
+    std::chrono::steady_clock::time_point lastFrameTime;
+    std::chrono::steady_clock::time_point idleSince;
+    long long framesDrawn = 0;
+    long long framesSkipped = 0;     // Frame intervals that passed without a redraw while idle
+    long long coalescedRequests = 0; // Redraw requests merged into an already scheduled frame
+};
+FrameScheduler scheduler;
 
-    float icebergMinX = icebergX - icebergHalfWidth;
-    float icebergMaxX = icebergX + icebergHalfWidth;
-    float icebergMinY = icebergY; // Base of iceberg
-    float icebergMaxY = icebergY + icebergHeight; // Top of iceberg
+// Anything that changes the picture without input keeps the scheduler awake.
+// New animated elements add their check here.
+bool sceneAnimating() {
+    if (replayRunning()) return true;
+    if (drawnOceanEnabled()) return true; // The waves never settle
+    if (particles.count > 0) return true; // Until the last splash has faded
+    if (shownSnapshot && shownSnapshot->inputsApplied < inputsQueued) return true; // The simulation thread has not shown it yet
+    const BoatStore& drawn = drawnBoats();
+    for (int i = 0; i < drawn.size(); i++) {
+        unsigned char f = drawn.flags[i];
+        if ((f & BOAT_SINKING) || (f & (BOAT_VISIBLE | BOAT_MOVING)) == (BOAT_VISIBLE | BOAT_MOVING)) return true;
+    }
+    return false;
+}
 
-    // Check for overlap on both X and Y axes (2D collision for simplicity)
-    bool xOverlap = (boatMaxX >= icebergMinX && boatMinX <= icebergMaxX);
-    bool yOverlap = (boatMaxY >= icebergMinY && boatMinY <= icebergMaxY);
+void timer(int);
 
-    if (xOverlap && yOverlap) {
-        boatVisible = false; // Boat is no longer "visible" as an active entity
-        isBoatMoving = false; // Stop any ongoing movement
-        isSinking = true;     // Start sinking animation
-        std::cout << "Collision! Boat started sinking." << std::endl; // For debugging
+// Schedule a frame now if the timer is idle
+void wakeScheduler() {
+    if (scheduler.timerArmed) {
+        scheduler.coalescedRequests++;
+        return;
     }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    scheduler.framesSkipped += (long long)(std::chrono::duration<double, std::milli>(now - scheduler.idleSince).count() / std::max(1, frameIntervalMs));
+    // Pretend one tick has passed so the input is followed by a simulation step (the zoom
+    // keys can push the iceberg into a parked boat); nothing else moves while idle
+    scheduler.lastFrameTime = now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / simulationRate));
+    scheduler.timerArmed = true;
+    glutTimerFunc(0, timer, 0);
+}
+
+// Printed when the window closes
+void printSchedulerStats() {
+    std::cout << "Frames drawn: " << scheduler.framesDrawn << ", skipped while idle: " << scheduler.framesSkipped
+        << ", redraw requests coalesced: " << scheduler.coalescedRequests << std::endl;
 }
 
 // Display function
 void display() {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear color and depth buffers
-    glLoadIdentity();             // Reset the modelview matrix
+    profilerFrame();
+    scheduler.framesDrawn++;
+    frameCounters = RenderCounters();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (simulationThreadRunning()) acquireSnapshot();
+    int timerSlot = beginFrameTiming();
+    renderFrame();
+    captureFrame(); // Before the overlay, which is not part of the recording
+    if (frameStallMs > 0 && scheduler.framesDrawn % 30 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(frameStallMs));
+    endFrameTiming(timerSlot, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()); // Not the swap, which may wait for vsync
+    drawProfilerOverlay();
+    {
+        PROFILE_SCOPE("glutSwapBuffers");
+        glutSwapBuffers(); // Swap the front and back buffers to display the scene
+    }
+    recordPresentLatency();
+}
 
-    // Set the light position (needs to be done in display before drawing objects)
-    GLfloat light_position[] = { sunLightX, sunLightY, sunLightZ, 1.0f }; // Positional light
-    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+// Reshape function: keep the viewport covering the whole window
+void reshape(int width, int height) {
+    windowWidth = std::max(1, width);
+    windowHeight = std::max(1, height);
+    sceneWidth = windowWidth;
+    sceneHeight = windowHeight;
+    glViewport(0, 0, windowWidth, windowHeight);
+    invalidateBackgroundCache(); // Re-rendered at the new size
+}
 
-    // Draw scenery elements first (background to foreground based on Z)
-    drawSky();
-    drawSun(); // This draws the visual sun, the light position is set above
-    drawClouds(); // Now 3D
-    drawWater();
-    drawIceberg(); // Already 3D
-    drawBoat();    // Already 3D
+// Ask for a redraw after input; headless runs draw every frame anyway and have no GLUT window
+void requestRedisplay() {
+    if (!headlessMode) wakeScheduler();
+}
 
-    glutSwapBuffers(); // Swap the front and back buffers to display the scene
+// One fixed simulation tick of dt seconds
+void simulationStep(float dt) {
+    PROFILE_SCOPE("simulationStep");
+    boats.savePrevious(); // Keep the last tick for render interpolation and the collision sweep (A/D steps included)
+    applyInput();         // Queued keyboard/mouse input (or the replayed trace) due at this tick
+    updateBoats(dt);      // Move boats towards their targets and sink the ones that hit an iceberg
+    floatBoats((float)(simulationTick + 1) / simulationRate); // Bob afloat boats on the waves (--ocean)
+    checkCollision();     // Check for collisions between boats and icebergs (after this tick's movement)
+    rebinFleetBoats();    // After collision, which can move a boat back to where it touched
+    simulationTick++;
+    checkReplayFinished();
+}
+
+// Run as many fixed ticks as the real time since the last call covers; the remainder
+// becomes the interpolation factor for rendering
+void advanceSimulation(double frameSeconds) {
+    double dt = 1.0 / simulationRate;
+    simulationAccumulator += std::min(frameSeconds, maxFrameDelta);
+    while (simulationAccumulator >= dt) {
+        simulationStep((float)dt);
+        simulationAccumulator -= dt;
+    }
+    renderAlpha = (float)(simulationAccumulator / dt);
 }
 
 // Timer for animation and updates
 void timer(int) {
-    if (boatVisible) {
-        // Animate boat movement towards targetBoatX (for mouse clicks)
-        if (isBoatMoving) {
-            float distance = targetBoatX - boatX;
-            if (std::abs(distance) > boatMovementSpeed) {
-                boatX += (distance > 0 ? 1 : -1) * boatMovementSpeed;
-            }
-            else {
-                boatX = targetBoatX; // Reached target
-                isBoatMoving = false;
-            }
-        }
-        checkCollision(); // Check for collision with iceberg
-    }
-    else if (isSinking) {
-        // Animate boat sinking
-        boatY -= sinkSpeed;
-        if (boatY < -1.0f) { // Sunk below screen
-            isSinking = false;
-            completelyGone = true;
-            std::cout << "Boat has completely sunk." << std::endl;
-        }
-    }
+    PROFILE_SCOPE("timer");
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    bool unbounded = replayUnbounded && replayRunning(); // --replay-fast: one tick per frame, no waiting
+    if (simulationThreadRunning()) acquireSnapshot(); // The simulation ticks by itself
+    else if (unbounded) advanceSimulation(1.0 / simulationRate);
+    else advanceSimulation(std::chrono::duration<double>(now - scheduler.lastFrameTime).count()); // Late frames run extra ticks instead of slowing the game down
+    scheduler.lastFrameTime = now;
 
     glutPostRedisplay(); // Request a redraw of the scene
-    glutTimerFunc(16, timer, 0); // Call timer again after 16 milliseconds (approx. 60 FPS)
+    if (scheduler.alwaysRedraw || sceneAnimating()) {
+        glutTimerFunc(unbounded ? 0 : frameIntervalMs, timer, 0); // Call timer again after one frame interval
+        return;
+    }
+    // Quiescent: draw the final state exactly and sleep until the next input
+    renderAlpha = 1.0f;
+    scheduler.timerArmed = false;
+    scheduler.idleSince = now;
 }
 
-// Keyboard function for zooming iceberg and boat movement, and resetting
+// Keyboard function: input is queued and applied at the next simulation tick
+// (render toggles take effect at once when the simulation has its own thread)
 void keyboard(unsigned char key, int x, int y) {
-    if (key == 's' || key == 'S') { // 'S' for zoom IN (makes iceberg bigger)
-        icebergZoomFactor += 0.1f;
-        if (icebergZoomFactor > 5.0f) icebergZoomFactor = 5.0f; // Cap max zoom
-    }
-    else if (key == 'w' || key == 'W') { // 'W' for zoom OUT (makes iceberg smaller)
-        icebergZoomFactor -= 0.1f;
-        if (icebergZoomFactor < 0.1f) icebergZoomFactor = 0.1f; // Don't allow negative or too small zoom
-    }
-    else if (key == 13) { // ASCII for Enter key
-        // Reset boat state
-        boatX = -1.2f;
-        boatY = 0.1f;
-        boatVisible = true;
-        isSinking = false;
-        completelyGone = false;
-        isBoatMoving = false;
-        targetBoatX = boatX;
-        std::cout << "Story reset! Boat is back." << std::endl;
-    }
-    else if (boatVisible && !isSinking) { // Only allow boat movement if visible and not sinking
-        if (key == 'd' || key == 'D') {
-            boatX += keyboardBoatSpeed; // Move boat forward (right)
-            isBoatMoving = false; // Stop any mouse-based target movement
-        }
-        else if (key == 'a' || key == 'A') {
-            boatX -= keyboardBoatSpeed; // Move boat backward (left)
-            isBoatMoving = false; // Stop any mouse-based target movement
-        }
-    }
-    glutPostRedisplay(); // Request a redraw
+    if (simulationThreadRunning() && isRenderKey(key)) applyRenderKey(key);
+    queueInput(INPUT_KEY, key, 0.0f);
+    requestRedisplay(); // Request a redraw
+}
+
+// Special keys (arrows, Home) move the camera; queued like the keyboard so traces replay them
+void specialKey(int key, int x, int y) {
+    if (simulationThreadRunning()) applySpecialKey((unsigned char)key);
+    queueInput(INPUT_SPECIAL, (unsigned char)key, 0.0f);
+    requestRedisplay();
 }
 
 // Mouse function for cursor-based boat movement target
 void mouseClick(int button, int state, int x, int y) {
-    // Only allow movement if the boat is visible and not currently sinking
-    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN && boatVisible && !isSinking) {
-        // Convert mouse X coordinate to OpenGL coordinates
-        // This is a direct mapping for orthographic projection
-        targetBoatX = (float)x / glutGet(GLUT_WINDOW_WIDTH) * 3.0f - 1.5f;
-        isBoatMoving = true; // Start boat animation
+    if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
+        // Convert mouse X coordinate to world coordinates through the camera's view
+        queueInput(INPUT_CLICK, 0, cameraWorldX(x));
+        requestRedisplay();
     }
 }
 
@@ -547,13 +5274,9 @@ void init() {
     glEnable(GL_LIGHT0);   // Enable light source 0
 
     // Define light properties
-    GLfloat light_ambient[] = { 0.2f, 0.2f, 0.2f, 1.0f }; // Dim ambient light
-    GLfloat light_diffuse[] = { 1.0f, 1.0f, 0.8f, 1.0f }; // Bright yellowish-white diffuse light (sun-like)
-    GLfloat light_specular[] = { 1.0f, 1.0f, 1.0f, 1.0f }; // White specular highlight
-
-    glLightfv(GL_LIGHT0, GL_AMBIENT, light_ambient);
-    glLightfv(GL_LIGHT0, GL_DIFFUSE, light_diffuse);
-    glLightfv(GL_LIGHT0, GL_SPECULAR, light_specular);
+    glLightfv(GL_LIGHT0, GL_AMBIENT, lightAmbient);
+    glLightfv(GL_LIGHT0, GL_DIFFUSE, lightDiffuse);
+    glLightfv(GL_LIGHT0, GL_SPECULAR, lightSpecular);
 
     // Enable color tracking (so glColor affects material properties)
     glEnable(GL_COLOR_MATERIAL);
@@ -561,24 +5284,650 @@ void init() {
     glColorMaterial(GL_FRONT, GL_AMBIENT_AND_DIFFUSE);
 
     // Set a default specular material and shininess for all objects if not specified individually
-    GLfloat default_specular[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-    glMaterialfv(GL_FRONT, GL_SPECULAR, default_specular);
-    glMaterialf(GL_FRONT, GL_SHININESS, 50.0f); // A moderate shininess
+    glMaterialfv(GL_FRONT, GL_SPECULAR, materialSpecular);
+    glMaterialf(GL_FRONT, GL_SHININESS, materialShininess);
+    glEnable(GL_RESCALE_NORMAL); // Cloud puffs are unit spheres scaled uniformly
+
+    // Story boat first, then the fleet (if any) behind it in the boat store
+    boats.add(boatStartX, boatStartY, boatMovementSpeed, 1.0f, BOAT_VISIBLE);
+    unsigned hardwareThreads = std::thread::hardware_concurrency();
+    workers.start(workerThreadCount >= 0 ? workerThreadCount : (hardwareThreads > 1 ? (int)hardwareThreads - 1 : 0)); // The main thread also works
+
+    createClouds();
+    buildSceneMeshes(); // Bake boat and iceberg geometry into vertex/index buffers
+    if (cloudLayer.spheres[0].vertexBuffer) bakeCloudImpostors(); // Atlas for the small clouds
+    initShaderRenderer(); // --shaders: uber-shader permutations and uniform buffers
+    initFleet();        // Instance buffers for --fleet
+    initBackgroundCache(); // Composite shader for the cached sky/sun/clouds/water layer
+    initOcean();        // Wave shader and water grid for --ocean
+    initParticles();    // Particle pool and sprite for splashes and wakes
+}
+
+// --- Headless benchmark (--headless <frames>) ---
+
+int headlessFrameCount = 0;   // Frames to render, 0 = interactive window
+std::string headlessJsonPath; // --json <file>: also write the results as JSON
+const std::chrono::steady_clock::time_point processStart = std::chrono::steady_clock::now(); // Startup is timed from here
+
+// Scripted session replayed by headless runs: sail into the iceberg, sink, reset with Enter.
+// Input goes through the same keyboard()/mouseClick() handlers as a real session.
+// Returns whether this frame had input. Not used when replaying a trace.
+const int scenarioCycleFrames = 480; // One full sail-sink-reset story at 60 frames per second
+bool playScenarioFrame(int frame) {
+    if (!inputReplayPath.empty()) return false; // --replay supplies the input instead
+    int t = frame % scenarioCycleFrames;
+    if (t == 0) {
+        keyboard(13, 0, 0); // Enter: boat back at the start
+        int icebergPixelX = cameraPixelX(icebergX);
+        mouseClick(GLUT_LEFT_BUTTON, GLUT_DOWN, icebergPixelX, windowHeight / 2); // Head for the iceberg
+    }
+    else if (t == 30) keyboard('s', 0, 0); // Zoom the iceberg in and back out while the boat sails
+    else if (t == 90) keyboard('w', 0, 0);
+    else return false;
+    return true;
+}
+
+// Value at fraction p of the sorted samples (nearest rank)
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t rank = (size_t)std::ceil(p * sorted.size());
+    return sorted[std::min(sorted.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+// Stop the simulation thread, if it runs, and print its tick steadiness and the input latency
+void stopSimulationThread() {
+    if (!simulationThreadRunning()) return;
+    simulationThread.stop();
+    std::vector<double> ticks = simulationThread.tickIntervalMs;
+    std::sort(ticks.begin(), ticks.end());
+    double sum = 0.0;
+    for (double ms : ticks) sum += ms;
+    std::printf("simulation thread: %zu ticks, interval ms mean %.3f  p50 %.3f  p95 %.3f  max %.3f (target %.3f)\n", ticks.size(),
+        sum / std::max<size_t>(1, ticks.size()), percentile(ticks, 0.50), percentile(ticks, 0.95), ticks.empty() ? 0.0 : ticks.back(), 1000.0 / simulationRate);
+    std::vector<double> latency = presentLatency.ms;
+    std::sort(latency.begin(), latency.end());
+    sum = 0.0;
+    for (double ms : latency) sum += ms;
+    std::printf("input to present: %zu inputs, ms mean %.3f  p50 %.3f  p95 %.3f  max %.3f\n", latency.size(),
+        sum / std::max<size_t>(1, latency.size()), percentile(latency, 0.50), percentile(latency, 0.95), latency.empty() ? 0.0 : latency.back());
+}
+
+#ifdef HEADLESS_SUPPORTED
+// Create a compatibility-profile GL context without any window or display server, using
+// Mesa's surfaceless EGL platform (llvmpipe when there is no GPU)
+bool createHeadlessContext() {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!getPlatformDisplay) {
+        std::cout << "EGL_EXT_platform_base not available." << std::endl;
+        return false;
+    }
+    EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        std::cout << "Could not open the surfaceless EGL display." << std::endl;
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+    const EGLint contextAttributes[] = { EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT, EGL_NONE };
+    EGLContext context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cout << "Could not create a headless OpenGL context." << std::endl;
+        return false;
+    }
+    return true;
+}
+#endif
+
+// Surfaceless contexts have no default framebuffer: render into color + depth renderbuffers
+bool createOffscreenFramebuffer(int width, int height) {
+    if (!glGenFramebuffers || !glGenRenderbuffers) return false;
+    GLuint framebuffer = 0, renderbuffers[2] = { 0, 0 };
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+// Render headlessFrameCount frames of the scripted scenario offscreen and report frame times.
+// Simulated time advances by exactly one 60 Hz frame per rendered frame, so every run (and
+// every build) renders the same sequence of scenes however long each frame takes. With
+// --sim-thread the simulation ticks in real time on its own thread instead, and frames are
+// paced at the --fps rate so the input-to-present latency means something.
+int runHeadless() {
+#ifndef HEADLESS_SUPPORTED
+    std::cout << "Headless mode is not supported on this platform." << std::endl;
+    return 1;
+#else
+    headlessMode = true;
+    if (!createHeadlessContext()) return 1;
+    init();
+    if (!createOffscreenFramebuffer(windowWidth, windowHeight)) {
+        std::cout << "Could not create the offscreen framebuffer." << std::endl;
+        return 1;
+    }
+    reshape(windowWidth, windowHeight);
+    double startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processStart).count();
+    if (profilerRequested) enableProfiler();
+    std::cout << "Headless: " << glGetString(GL_RENDERER) << ", " << windowWidth << "x" << windowHeight
+        << ", " << headlessFrameCount << " frames" << std::endl;
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> frameMs;
+    frameMs.reserve(headlessFrameCount);
+    long long totalDrawCalls = 0, totalVertices = 0, totalStateSubmitted = 0, totalStateExecuted = 0, totalObjectsVisited = 0;
+    long long arenaAllocationsAfterFirstFrame = 0;
+    int idleFrames = 0;     // Frames the windowed scheduler would have skipped
+    bool animating = true;  // The first frame is always drawn
+    if (simulationThreadRequested) startSimulationThread();
+    Clock::time_point nextFrame = Clock::now();
+    for (int frame = 0; frame < headlessFrameCount; frame++) {
+        if (simulationThreadRunning()) {
+            std::this_thread::sleep_until(nextFrame);
+            nextFrame += std::chrono::milliseconds(frameIntervalMs);
+        }
+        if (!playScenarioFrame(frame) && !animating) idleFrames++;
+        profilerFrame();
+        Clock::time_point start = Clock::now();
+        if (simulationThreadRunning()) acquireSnapshot();
+        else advanceSimulation(1.0 / 60.0);
+        animating = sceneAnimating();
+        frameCounters = RenderCounters();
+        renderFrame();
+        captureFrame();
+        if (frameStallMs > 0 && frame % 30 == 29) std::this_thread::sleep_for(std::chrono::milliseconds(frameStallMs));
+        {
+            PROFILE_SCOPE("glFinish");
+            glFinish(); // Include the rasterization work, not just command submission
+        }
+        recordPresentLatency();
+        frameMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        updateDynamicResolution(frameMs.back());
+        totalDrawCalls += frameCounters.drawCalls;
+        totalVertices += frameCounters.vertices;
+        totalStateSubmitted += frameCounters.stateChangesSubmitted;
+        totalStateExecuted += frameCounters.stateChangesExecuted;
+        totalObjectsVisited += frameCounters.objectsVisited;
+        if (frame == 0) arenaAllocationsAfterFirstFrame = -renderQueue.arena.heapAllocations;
+    }
+
+    std::vector<double> sorted = frameMs;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double ms : frameMs) sum += ms;
+    int frames = std::max(1, headlessFrameCount);
+    double meanMs = sum / frames;
+    double p50 = percentile(sorted, 0.50), p95 = percentile(sorted, 0.95), p99 = percentile(sorted, 0.99);
+    double maxMs = sorted.empty() ? 0.0 : sorted.back();
+    std::printf("frame ms: mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n", meanMs, p50, p95, p99, maxMs);
+    std::printf("per frame: %.1f draw calls, %.0f vertices submitted\n", (double)totalDrawCalls / frames, (double)totalVertices / frames);
+    std::printf("startup: %.1f ms to the first frame", startupMs);
+    if (scene.loaded()) std::printf(" (scene opened in %.2f ms, meshes uploaded in %.2f ms)", scene.loadMs, scene.uploadMs);
+    std::printf("\n");
+    arenaAllocationsAfterFirstFrame += renderQueue.arena.heapAllocations;
+    if (useRetainedMeshes) {
+        std::printf("clouds: %d, %d drawn as impostors, %zu spheres for the rest\n", (int)cloudLayer.clouds.size(), cloudLayer.impostorClouds, cloudLayer.sphereDraws.size());
+    }
+    if (fleetMode) {
+        std::printf("fleet culling: %.0f of %d objects visited per frame (world %.0f wide, camera at %.2f, zoom %.2f); %lld boats re-binned by the simulation\n",
+            (double)totalObjectsVisited / frames, fleetBoatCount + fleetIcebergCount, worldWidth, camera.x, camera.zoom, fleetBoatGrid.moves);
+    }
+    std::printf("idle frames (skipped by the windowed scheduler): %d of %d\n", idleFrames, headlessFrameCount);
+    if (particles.buffer) {
+        std::printf("particles: %.0f live per frame (peak %d of %d), %lld emitted, %lld dropped with the pool full; update %.3f ms/frame\n",
+            (double)particles.liveSum / std::max(1LL, particles.updatedFrames), particles.peak, particles.capacity, particles.emitted, particles.dropped,
+            particles.updateMs / frames);
+    }
+    bool threaded = simulationThreadRunning();
+    stopSimulationThread();
+    finishCapture();
+    printDynamicResolutionStats();
+    std::printf("render queue: %.1f state changes per frame in submission order, %.1f executed%s; arena heap allocations after the first frame: %lld\n",
+        (double)totalStateSubmitted / frames, (double)totalStateExecuted / frames, renderQueue.sorted ? " (sorted)" : " (unsorted)", arenaAllocationsAfterFirstFrame);
+    if (profiler.enabled) {
+        if (profiler.gpuTimers) pollGpuTimings(); // Everything has finished after the last glFinish()
+        for (const std::string& line : profilerReport(true)) std::cout << line << std::endl;
+    }
+
+    if (!headlessJsonPath.empty()) {
+        std::ofstream json(headlessJsonPath);
+        json << "{\n"
+            << "  \"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n"
+            << "  \"width\": " << windowWidth << ",\n"
+            << "  \"height\": " << windowHeight << ",\n"
+            << "  \"frames\": " << headlessFrameCount << ",\n"
+            << "  \"retained_meshes\": " << (useRetainedMeshes ? "true" : "false") << ",\n"
+            << "  \"shader_renderer\": " << (useShaderRenderer ? "true" : "false") << ",\n"
+            << "  \"background_cache\": " << (useBackgroundCache && backgroundCache.program ? "true" : "false") << ",\n"
+            << "  \"ocean_grid\": " << (oceanEnabled ? (long long)ocean.columns * ocean.rows : 0) << ",\n"
+            << "  \"fleet_boats\": " << (fleetMode ? fleetBoatCount : 0) << ",\n"
+            << "  \"fleet_icebergs\": " << (fleetMode ? fleetIcebergCount : 0) << ",\n"
+            << "  \"world_width\": " << worldWidth << ",\n"
+            << "  \"startup_ms\": " << startupMs << ",\n"
+            << "  \"objects_visited_per_frame\": " << (double)totalObjectsVisited / frames << ",\n"
+            << "  \"fleet_boats_rebinned\": " << fleetBoatGrid.moves << ",\n"
+            << "  \"frame_ms\": { \"mean\": " << meanMs << ", \"p50\": " << p50 << ", \"p95\": " << p95
+            << ", \"p99\": " << p99 << ", \"max\": " << maxMs << " },\n"
+            << "  \"idle_frames\": " << idleFrames << ",\n"
+            << "  \"frame_budget_ms\": " << dynamicResolution.budgetMs << ",\n"
+            << "  \"resolution_scale\": { \"final\": " << dynamicResolution.scale << ", \"mean\": "
+            << (dynamicResolution.frames ? dynamicResolution.scaleSum / dynamicResolution.frames : 1.0) << ", \"changes\": " << dynamicResolution.changes << " },\n"
+            << "  \"particles\": { \"capacity\": " << particles.capacity << ", \"peak\": " << particles.peak << ", \"emitted\": " << particles.emitted
+            << ", \"dropped\": " << particles.dropped << ", \"update_ms_per_frame\": " << particles.updateMs / frames << " },\n"
+            << "  \"capture\": { \"frames\": " << capture.written << ", \"dropped\": " << capture.dropped << " },\n"
+            << "  \"simulation_thread\": " << (threaded ? "true" : "false") << ",\n"
+            << "  \"input_to_present_ms\": [";
+        for (size_t i = 0; i < presentLatency.ms.size(); i++) json << (i ? ", " : "") << presentLatency.ms[i];
+        json << "],\n"
+            << "  \"state_changes_submitted_per_frame\": " << (double)totalStateSubmitted / frames << ",\n"
+            << "  \"state_changes_executed_per_frame\": " << (double)totalStateExecuted / frames << ",\n"
+            << "  \"draw_calls_per_frame\": " << (double)totalDrawCalls / frames << ",\n"
+            << "  \"vertices_per_frame\": " << (double)totalVertices / frames << "\n"
+            << "}\n";
+        if (!json) {
+            std::cout << "Could not write " << headlessJsonPath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << headlessJsonPath << std::endl;
+    }
+    saveInputTrace();
+    saveProfilerTrace();
+    return 0;
+#endif
+}
+
+// --- Batch simulation (--batch <episodes>) ---
+// Runs many independent story episodes without rendering, to tune the boat, keyboard and sink
+// speeds. Each episode places the story boat at a random start, scales the iceberg to a random
+// zoom and then either clicks a random target or taps D at a random rate, and ticks it with the
+// game's own code (applyClick()/applyKey()'s sendBoat()/nudgeBoat(), updateBoatRange() and
+// sinkCollidingBoats(), in simulationStep()'s order) until the boat has sunk or come to rest.
+// Episodes are seeded by their index, so the results don't depend on the thread count.
+long long batchEpisodes = 0;          // 0 = no batch run
+std::uint64_t batchSeed = 1;
+float batchZoomMin = 0.1f, batchZoomMax = 5.0f; // The range the S/W keys allow
+const double batchEpisodeLimit = 60.0; // Simulated seconds before an episode is cut off
+
+// Per-episode random numbers: splitmix64, cheap to seed for every episode
+struct EpisodeRandom {
+    std::uint64_t state;
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    float uniform(float low, float high) { return low + (high - low) * (float)((next() >> 40) * (1.0 / 16777216.0)); }
+};
+
+// What one thread has seen; merged at the end
+struct BatchTally {
+    long long episodes = 0;
+    long long collisions = 0;
+    long long cutOff = 0;    // Still going after batchEpisodeLimit
+    long long ticks = 0;
+    long long steals = 0;
+    std::vector<float> collisionSeconds; // From the first input to the hit
+    std::vector<float> sinkSeconds;      // From the hit until the boat is gone
+};
+
+// One boat and the story iceberg, reused from episode to episode
+struct EpisodeWorld {
+    BoatStore store;
+    Broadphase collision;
+    EpisodeWorld() {
+        store.add(boatStartX, boatStartY, boatMovementSpeed, 1.0f, BOAT_VISIBLE);
+        collision.resize(1, 1);
+    }
+};
+
+void runEpisode(EpisodeWorld& world, long long episode, BatchTally& tally) {
+    EpisodeRandom random = { batchSeed ^ ((std::uint64_t)episode * 0xD1B54A32D192ED03ull) };
+    BoatStore& store = world.store;
+    resetBoat(store, 0, random.uniform(-1.5f, 0.5f), boatStartY);
+    float zoom = random.uniform(batchZoomMin, batchZoomMax);
+    bool keyboardEpisode = random.next() & 1;
+    float clickTarget = random.uniform(-1.5f, 1.5f);
+    int keyInterval = 1 + (int)(random.next() % 30); // Ticks between D presses
+    const float screenEdge = 1.5f;
+
+    world.collision.resize(1, 1);
+    world.collision.moveIceberg(0, icebergX, icebergY, zoom);
+    const float dt = 1.0f / simulationRate;
+    const int tickLimit = (int)(batchEpisodeLimit * simulationRate);
+    int hitTick = -1;
+    float hitFraction = 1.0f; // Part of the tick before the boat touched the iceberg
+    int tick = 0;
+    for (; tick < tickLimit; tick++) {
+        // Input first, as applyInput() does at the start of a tick
+        store.savePrevious();
+        if (!keyboardEpisode && tick == 0) sendBoat(store, 0, clickTarget, boatMovementSpeed);
+        bool pressing = keyboardEpisode && store.x[0] < screenEdge;
+        if (pressing && tick % keyInterval == 0) nudgeBoat(store, 0, keyboardBoatSpeed);
+        updateBoatRange(store, 0, 1, dt, sinkSpeed);
+        sinkCollidingBoats(world.collision, store, tick == 0, [&](int, float fraction) { hitTick = tick; hitFraction = fraction; });
+        unsigned char flags = store.flags[0];
+        if (flags & BOAT_GONE) break;
+        if ((flags & BOAT_VISIBLE) && !(flags & BOAT_MOVING) && !pressing) break; // At rest for good
+    }
+    tally.episodes++;
+    tally.ticks += std::min(tick + 1, tickLimit);
+    if (tick == tickLimit) tally.cutOff++;
+    if (hitTick >= 0) {
+        tally.collisions++;
+        tally.collisionSeconds.push_back((hitTick + hitFraction) * dt);
+        if (store.flags[0] & BOAT_GONE) tally.sinkSeconds.push_back((tick - hitTick) * dt);
+    }
+}
+
+// Range of episodes a thread works through; others steal the back half when they run dry
+struct alignas(64) EpisodeRange {
+    std::mutex mutex;
+    long long begin = 0;
+    long long end = 0;
+};
+
+// Work-stealing loop of one batch thread: take chunks off the front of its own range, and
+// once that is empty split the largest remaining range of another thread
+void batchThread(int self, std::vector<EpisodeRange>& ranges, BatchTally& tally) {
+    const long long chunk = 256;
+    EpisodeWorld world;
+    EpisodeRange& own = ranges[self];
+    for (;;) {
+        long long begin, end;
+        {
+            std::lock_guard<std::mutex> lock(own.mutex);
+            begin = own.begin;
+            end = std::min(own.end, begin + chunk);
+            own.begin = end;
+        }
+        if (begin < end) {
+            for (long long episode = begin; episode < end; episode++) runEpisode(world, episode, tally);
+            continue;
+        }
+        // Steal from the thread with the most left
+        int victim = -1;
+        long long most = 0;
+        for (int i = 0; i < (int)ranges.size(); i++) {
+            if (i == self) continue;
+            std::lock_guard<std::mutex> lock(ranges[i].mutex);
+            if (ranges[i].end - ranges[i].begin > most) {
+                most = ranges[i].end - ranges[i].begin;
+                victim = i;
+            }
+        }
+        if (victim < 0) return; // Nothing left anywhere
+        std::lock(ranges[victim].mutex, own.mutex);
+        std::lock_guard<std::mutex> victimLock(ranges[victim].mutex, std::adopt_lock);
+        std::lock_guard<std::mutex> ownLock(own.mutex, std::adopt_lock);
+        EpisodeRange& from = ranges[victim];
+        long long left = from.end - from.begin;
+        if (left <= 0) continue; // Taken meanwhile; look again
+        long long middle = from.begin + (left + 1) / 2; // A lone episode goes to the thief
+        own.begin = middle;
+        own.end = from.end;
+        from.end = middle;
+        tally.steals++;
+    }
+}
+
+// mean p50 p95 of a sample list, in place
+void printDistribution(const char* name, std::vector<float>& values) {
+    if (values.empty()) {
+        std::printf("%s: no samples\n", name);
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (float v : values) sum += v;
+    std::vector<double> sorted(values.begin(), values.end());
+    std::printf("%s: mean %.3f  p50 %.3f  p95 %.3f  max %.3f s\n", name, sum / values.size(), percentile(sorted, 0.50), percentile(sorted, 0.95), sorted.back());
+}
+
+int runBatch() {
+    unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+    int threadCount = workerThreadCount >= 0 ? workerThreadCount + 1 : (int)hardwareThreads; // --threads counts the extra threads
+    std::printf("Batch: %lld episodes on %d threads (boat speed %.3f, key step %.3f, sink speed %.3f, zoom %.2f-%.2f, %d Hz, seed %llu)\n",
+        batchEpisodes, threadCount, boatMovementSpeed, keyboardBoatSpeed, sinkSpeed, batchZoomMin, batchZoomMax, simulationRate, (unsigned long long)batchSeed);
+    std::vector<EpisodeRange> ranges(threadCount);
+    for (int i = 0; i < threadCount; i++) {
+        ranges[i].begin = batchEpisodes * i / threadCount;
+        ranges[i].end = batchEpisodes * (i + 1) / threadCount;
+    }
+    std::vector<BatchTally> tallies(threadCount);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threadCount; i++) threads.emplace_back(batchThread, i, std::ref(ranges), std::ref(tallies[i]));
+    batchThread(0, ranges, tallies[0]);
+    for (std::thread& thread : threads) thread.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    BatchTally total;
+    for (BatchTally& tally : tallies) {
+        total.episodes += tally.episodes;
+        total.collisions += tally.collisions;
+        total.cutOff += tally.cutOff;
+        total.ticks += tally.ticks;
+        total.steals += tally.steals;
+        total.collisionSeconds.insert(total.collisionSeconds.end(), tally.collisionSeconds.begin(), tally.collisionSeconds.end());
+        total.sinkSeconds.insert(total.sinkSeconds.end(), tally.sinkSeconds.begin(), tally.sinkSeconds.end());
+    }
+    double episodesPerSecond = total.episodes / std::max(seconds, 1e-9);
+    std::printf("%.3f s: %.0f episodes/s, %.3g ticks/s, %lld steals\n", seconds, episodesPerSecond, total.ticks / std::max(seconds, 1e-9), total.steals);
+    std::printf("collision rate: %.2f%% (%lld of %lld episodes), %lld cut off after %.0f s\n",
+        100.0 * total.collisions / std::max(1LL, total.episodes), total.collisions, total.episodes, total.cutOff, batchEpisodeLimit);
+    printDistribution("time to collision", total.collisionSeconds);
+    printDistribution("sink duration", total.sinkSeconds);
+
+    if (!headlessJsonPath.empty()) {
+        std::ofstream json(headlessJsonPath);
+        json << "{\n"
+            << "  \"episodes\": " << total.episodes << ",\n"
+            << "  \"threads\": " << threadCount << ",\n"
+            << "  \"seconds\": " << seconds << ",\n"
+            << "  \"episodes_per_second\": " << episodesPerSecond << ",\n"
+            << "  \"steals\": " << total.steals << ",\n"
+            << "  \"boat_speed\": " << boatMovementSpeed << ",\n"
+            << "  \"key_step\": " << keyboardBoatSpeed << ",\n"
+            << "  \"sink_speed\": " << sinkSpeed << ",\n"
+            << "  \"zoom\": [" << batchZoomMin << ", " << batchZoomMax << "],\n"
+            << "  \"collision_rate\": " << (double)total.collisions / std::max(1LL, total.episodes) << ",\n"
+            << "  \"mean_time_to_collision_s\": " << (total.collisionSeconds.empty() ? 0.0 : std::accumulate(total.collisionSeconds.begin(), total.collisionSeconds.end(), 0.0) / total.collisionSeconds.size()) << ",\n"
+            << "  \"mean_sink_duration_s\": " << (total.sinkSeconds.empty() ? 0.0 : std::accumulate(total.sinkSeconds.begin(), total.sinkSeconds.end(), 0.0) / total.sinkSeconds.size()) << "\n"
+            << "}\n";
+        if (!json) {
+            std::cout << "Could not write " << headlessJsonPath << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << headlessJsonPath << std::endl;
+    }
+    return 0;
+}
+
+// --- Baked lighting check (--check-baked-lighting) ---
+// Renders the scene offscreen with baked and with live lighting, at the start zoom and after
+// zooming the iceberg in and out (which must rebake it), and compares the images. Rasterizing
+// the pre-transformed meshes can move an edge pixel, so a few outliers are allowed.
+const int bakeCheckTolerance = 3;            // Largest per-channel difference of a matching pixel
+const double bakeCheckOutlierFraction = 0.001; // Share of pixels allowed beyond the tolerance
+
+int checkBakedLighting() {
+#ifndef HEADLESS_SUPPORTED
+    std::cout << "The baked lighting check needs headless support." << std::endl;
+    return 1;
+#else
+    headlessMode = true;
+    if (!createHeadlessContext()) return 1;
+    init();
+    if (!createOffscreenFramebuffer(windowWidth, windowHeight)) {
+        std::cout << "Could not create the offscreen framebuffer." << std::endl;
+        return 1;
+    }
+    reshape(windowWidth, windowHeight);
+    if (!bakedLightingActive()) {
+        std::cout << "Baked lighting is off (it needs the fixed-function retained-mode path)." << std::endl;
+        return 1;
+    }
+
+    struct Step { const char* name; unsigned char key; int presses; };
+    const Step steps[] = { { "start zoom", 0, 0 }, { "zoomed in", 's', 10 }, { "zoomed out", 'w', 25 } };
+    size_t pixelCount = (size_t)windowWidth * windowHeight;
+    std::vector<unsigned char> baked(pixelCount * 4), live(pixelCount * 4);
+    bool passed = true;
+    for (const Step& step : steps) {
+        for (int i = 0; i < step.presses; i++) applyKey(step.key);
+        bakedLighting.enabled = true;
+        renderScene();
+        glReadPixels(0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, baked.data());
+        bakedLighting.enabled = false;
+        renderScene();
+        glReadPixels(0, 0, windowWidth, windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, live.data());
+
+        int maxDifference = 0;
+        size_t outliers = 0;
+        double sum = 0.0;
+        for (size_t p = 0; p < pixelCount; p++) {
+            int pixelDifference = 0;
+            for (int c = 0; c < 3; c++) pixelDifference = std::max(pixelDifference, std::abs(baked[p * 4 + c] - live[p * 4 + c]));
+            maxDifference = std::max(maxDifference, pixelDifference);
+            if (pixelDifference > bakeCheckTolerance) outliers++;
+            sum += pixelDifference;
+        }
+        bool ok = outliers <= pixelCount * bakeCheckOutlierFraction;
+        passed = passed && ok;
+        std::printf("%-10s (zoom %.1f): mean difference %.3f, max %d, %zu pixels beyond %d  %s\n", step.name, icebergZoomFactor,
+            sum / pixelCount, maxDifference, outliers, bakeCheckTolerance, ok ? "ok" : "FAILED");
+    }
+    std::printf("%d bakes. Baked lighting %s the live-lit image.\n", bakedLighting.bakes, passed ? "matches" : "does not match");
+    return passed ? 0 : 1;
+#endif
 }
 
 // Main function
 int main(int argc, char** argv) {
+    // Our own options are parsed first so the benchmark modes run without a display;
+    // glutInit leaves arguments it does not know about alone
+    bool runBroadphaseBenchmark = false;
+    bool runNarrowphaseBenchmark = false;
+    bool runBakeCheck = false;
+    bool simulationThreadFlag = false;
+    std::string scenePath, sceneWritePath;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc) simulationRate = std::max(1, std::atoi(argv[++i])); // Simulation ticks per second
+        else if (std::strcmp(argv[i], "--fps") == 0 && i + 1 < argc) frameIntervalMs = 1000 / std::max(1, std::atoi(argv[++i])); // Redisplay rate
+        else if (std::strcmp(argv[i], "--immediate") == 0) useRetainedMeshes = false; // Start on the glBegin/glEnd path
+        else if (std::strcmp(argv[i], "--shaders") == 0) useShaderRenderer = true; // Per-pixel lighting shaders, falls back to fixed function
+        else if (std::strcmp(argv[i], "--ocean") == 0) oceanEnabled = true; // Animated water grid, waves in the vertex shader
+        else if (std::strcmp(argv[i], "--ocean-grid") == 0 && i + 2 < argc) { // --ocean-grid <columns> <rows>
+            ocean.columns = std::max(1, std::atoi(argv[++i]));
+            ocean.rows = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--clouds") == 0 && i + 1 < argc) cloudLayer.extraClouds = std::max(0, std::atoi(argv[++i])); // Extra clouds in the sky
+        else if (std::strcmp(argv[i], "--no-cloud-lod") == 0) cloudLayer.useLod = false; // Every cloud as full-detail spheres
+        else if (std::strcmp(argv[i], "--live-lighting") == 0) bakedLighting.enabled = false; // Light the static meshes every frame
+        else if (std::strcmp(argv[i], "--check-baked-lighting") == 0) runBakeCheck = true; // Compare baked and live lighting offscreen and exit
+        else if (std::strcmp(argv[i], "--unsorted-queue") == 0) renderQueue.sorted = false; // Draw queued commands in submission order
+        else if (std::strcmp(argv[i], "--no-bg-cache") == 0) useBackgroundCache = false; // Draw the background every frame
+        else if (std::strcmp(argv[i], "--fleet") == 0 && i + 2 < argc) { // --fleet <boats> <icebergs>
+            fleetMode = true;
+            fleetBoatCount = std::max(0, std::atoi(argv[++i]));
+            fleetIcebergCount = std::max(0, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) scenePath = argv[++i]; // Load meshes and objects from a scene file
+        else if (std::strcmp(argv[i], "--write-scene") == 0 && i + 1 < argc) sceneWritePath = argv[++i]; // Convert the scene to a file and exit
+        else if (std::strcmp(argv[i], "--world") == 0 && i + 1 < argc) worldWidth = std::max(3.0f, (float)std::atof(argv[++i])); // Length of the fleet's strip of ocean
+        else if (std::strcmp(argv[i], "--camera") == 0 && i + 2 < argc) { // --camera <x> <zoom>
+            camera.x = (float)std::atof(argv[++i]);
+            camera.zoom = (float)std::atof(argv[++i]);
+        }
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) workerThreadCount = std::max(0, std::atoi(argv[++i])); // Extra worker threads
+        else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) batchEpisodes = std::max(1LL, std::atoll(argv[++i])); // Render-free episodes
+        else if (std::strcmp(argv[i], "--batch-seed") == 0 && i + 1 < argc) batchSeed = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--batch-zoom") == 0 && i + 2 < argc) { // --batch-zoom <min> <max>
+            batchZoomMin = (float)std::atof(argv[++i]);
+            batchZoomMax = std::max(batchZoomMin, (float)std::atof(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--boat-speed") == 0 && i + 1 < argc) boatMovementSpeed = (float)std::atof(argv[++i]); // Tuning
+        else if (std::strcmp(argv[i], "--key-step") == 0 && i + 1 < argc) keyboardBoatSpeed = (float)std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--sink-speed") == 0 && i + 1 < argc) sinkSpeed = (float)std::atof(argv[++i]);
+        else if (std::strcmp(argv[i], "--bench-broadphase") == 0) runBroadphaseBenchmark = true; // Print collision throughput and exit
+        else if (std::strcmp(argv[i], "--bench-narrowphase") == 0) runNarrowphaseBenchmark = true; // Print swept vs. AABB accuracy and cost and exit
+        else if (std::strcmp(argv[i], "--aabb-collision") == 0) aabbCollision = true; // Old instantaneous bounding-box collision
+        else if (std::strcmp(argv[i], "--headless") == 0 && i + 1 < argc) headlessFrameCount = std::max(1, std::atoi(argv[++i])); // Offscreen benchmark
+        else if (std::strcmp(argv[i], "--profile") == 0) profilerRequested = true; // Per-scope CPU/GPU timers
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) { // Chrome trace-event JSON written on exit
+            profiler.tracePath = argv[++i];
+            profilerRequested = true;
+        }
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) inputRecordPath = argv[++i]; // Save the input trace on exit
+        else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc) inputReplayPath = argv[++i]; // Play a recorded input trace
+        else if (std::strcmp(argv[i], "--single-thread") == 0) simulationThreadRequested = false; // Tick the simulation from the frame timer
+        else if (std::strcmp(argv[i], "--sim-thread") == 0) simulationThreadFlag = true; // Headless: simulation thread too
+        else if (std::strcmp(argv[i], "--frame-stall") == 0 && i + 1 < argc) frameStallMs = std::max(0, std::atoi(argv[++i])); // Stall every 30th frame
+        else if (std::strcmp(argv[i], "--replay-fast") == 0) replayUnbounded = true; // Replay without waiting for real time
+        else if (std::strcmp(argv[i], "--always-redraw") == 0) scheduler.alwaysRedraw = true; // Redraw every frame interval even when idle
+        else if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc) headlessJsonPath = argv[++i];
+        else if (std::strcmp(argv[i], "--particles") == 0 && i + 1 < argc) particles.capacity = std::max(0, std::atoi(argv[++i])); // Particle pool size
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc) capture.path = argv[++i]; // Record every frame to a file
+        else if (std::strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc) dynamicResolution.budgetMs = std::max(0.0, std::atof(argv[++i])); // Dynamic resolution
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 2 < argc) { // --size <width> <height>
+            windowWidth = std::max(1, std::atoi(argv[++i]));
+            windowHeight = std::max(1, std::atoi(argv[++i]));
+        }
+    }
+    clampCamera(); // --camera may be outside the --world strip
+    // Replays tick from the frames so they reproduce exactly; headless runs keep their fixed
+    // 60 Hz frame steps unless asked
+    if (!inputReplayPath.empty() || (headlessFrameCount > 0 && !simulationThreadFlag)) simulationThreadRequested = false;
+    if (runBroadphaseBenchmark) {
+        benchmarkBroadphase();
+        return 0;
+    }
+    if (runNarrowphaseBenchmark) {
+        benchmarkNarrowphase();
+        return 0;
+    }
+    if (batchEpisodes > 0) return runBatch(); // No window or GL context
+    if (!scenePath.empty() && !openScene(scenePath)) return 1;
+    if (!sceneWritePath.empty()) { // The objects init() would create, without a GL context
+        boats.add(boatStartX, boatStartY, boatMovementSpeed, 1.0f, BOAT_VISIBLE);
+        createClouds();
+        useSceneFleet();
+        if (fleetMode) createFleet();
+        return writeScene(sceneWritePath) ? 0 : 1;
+    }
+    if (!inputReplayPath.empty() && !loadInputTrace(inputReplayPath)) return 1;
+    if (runBakeCheck) return checkBakedLighting();
+    if (headlessFrameCount > 0) return runHeadless();
+
     glutInit(&argc, argv); // Initialize GLUT
     glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH); // Add GLUT_DEPTH for depth testing
-    glutInitWindowSize(800, 600); // Set window size
+    glutInitWindowSize(windowWidth, windowHeight); // Set window size
     glutCreateWindow("3D Boat, Clouds, and Iceberg Story - Orthographic View"); // Create a window with the given title
 
     init(); // Call initialization function
+    if (profilerRequested) enableProfiler();
+    if (simulationThreadRequested) startSimulationThread();
 
     glutDisplayFunc(display);       // Register display callback function
+    glutReshapeFunc(reshape);       // Register reshape callback function
     glutKeyboardFunc(keyboard);     // Register keyboard callback function
+    glutSpecialFunc(specialKey);    // Arrows and Home move the camera
     glutMouseFunc(mouseClick);      // Register mouse click callback function
+    glutCloseFunc(finishCapture);   // The last captured frames need the GL context
+    scheduler.lastFrameTime = std::chrono::steady_clock::now();
+    scheduler.timerArmed = true;
     glutTimerFunc(0, timer, 0);     // Register timer callback for animation
+    std::atexit(printSchedulerStats);
+    std::atexit(printDynamicResolutionStats);
+    std::atexit(saveInputTrace);
+    std::atexit(saveProfilerTrace);
+    std::atexit(stopSimulationThread); // Registered last so it runs first: the trace is complete once the thread has stopped
 
     glutMainLoop(); // Enter the GLUT event processing loop
     return 0;